@@ -7,22 +7,6 @@
 #include <errno.h>
 #include "barrier_user.h"
 
-int get_barrier(key_t key, int flags){
-        return syscall(nr_get_barrier,key,flags);
-}
-
-int sleep_on_barrier(int bd, int tag){
-        return syscall(nr_sleep_on_barrier,bd,tag);
-}
-
-int awake_barrier(int bd, int tag){
-        return syscall(nr_awake_barrier,bd,tag);
-}
-
-int release_barrier(int md){
-        return syscall(nr_release_barrier,md);
-}
-
 
 int main(int argc, char** argv){
 	int id,awake,tag;
@@ -0,0 +1,55 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <linux/ipc.h>
+#include <errno.h>
+#include "barrier_user.h"
+
+/*
+ * Wake up all the tags greater than or equal to the given one
+ */
+
+int awake_barrier_from(int bd, int tag){
+        return awake_barrier_mask(bd,BARRIER_TAGS_FROM(tag));
+}
+
+
+int main(int argc, char** argv){
+        int id,awake;
+        unsigned long long mask;
+        if(argc==3 || (argc==4 && !strcmp(argv[2],"-from"))){
+                id = strtol(argv[1],NULL,10);
+                if(argc==3){
+                        mask = strtoull(argv[2],NULL,0);
+                        printf("Waking up tags with mask %#llx of barrier with id %d\n",mask,id);
+                        awake=awake_barrier_mask(id,mask);
+                }
+                else{
+                        printf("Waking up tags from %s of barrier with id %d\n",argv[3],id);
+                        awake=awake_barrier_from(id,strtol(argv[3],NULL,10));
+                }
+                if(awake>=0) {
+                        printf("%d tags of barrier with id %d successfully woken up\n",awake,id);
+                        return 0;
+                }
+                else{
+                        switch(errno){
+                                case EINVAL:{
+                                        printf("Error while waking up tags of barrier with id %d:invalid barrier id or mask\n",id);
+                                        break;
+                                }
+                                case ENOSYS:{
+                                        printf("Error while waking up tags of barrier with id %d: \"barrier_module\" not inserted\n",id);
+                                        break;
+                                }
+                                default:
+                                        printf("Error while waking up tags of barrier with id %d:%d\n",id,errno);
+                        }
+                        return errno;
+                }
+        }
+        else
+                printf("Invalid arguments: provide valid barrier ID and mask of tags, or \"-from\" followed by a tag\n");
+}
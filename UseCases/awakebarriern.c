@@ -0,0 +1,39 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <linux/ipc.h>
+#include <errno.h>
+#include "barrier_user.h"
+
+
+int main(int argc, char** argv){
+        int id,woken,tag,n;
+        if(argc==4){
+                id = strtol(argv[1],NULL,10);
+                tag = strtol(argv[2],NULL,10);
+                n = strtol(argv[3],NULL,10);
+                printf("Waking up at most %d processes of tag %d of barrier with id %d\n",n,tag,id);
+                woken=awake_barrier_n(id,tag,n);
+                if(woken>=0) {
+                        printf("%d processes of tag %d of barrier with id %d woken up\n",woken,tag,id);
+                        return 0;
+                }
+                switch(errno){
+                        case EINVAL:{
+                                printf("Error while waking up tag %d of barrier with id %d:invalid barrier id, tag or number of processes\n",tag,id);
+                                break;
+                        }
+                        case ENOSYS:{
+                                printf("Error while waking up tag %d of barrier with id %d: \"barrier_module\" not inserted\n",tag,id);
+                                break;
+                        }
+                        default:
+                                printf("Error while waking up tag %d of barrier with id %d:%d\n",tag,id,errno);
+                }
+                return errno;
+        }
+        printf("Invalid arguments: only provide valid barrier ID, synchronization tag and number of processes to be woken up\n");
+        return EINVAL;
+}
@@ -1,9 +1,257 @@
 #ifndef BARRIERSYNCHRONIZATION_BARRIER_USER_H
 #define BARRIERSYNCHRONIZATION_BARRIER_USER_H
 
-#define nr_get_barrier 17
-#define nr_sleep_on_barrier 31
-#define nr_awake_barrier 32
-#define nr_release_barrier 35
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include "../barrier_ioctl.h"
+
+/*
+ * Flags of get_barrier: processes spin for a short time before going to sleep on the barrier
+ * (BARRIER_ADAPTIVE), the structures of all the dense tags are allocated with the barrier (BARRIER_PREALLOC)
+ */
+
+#define BARRIER_ADAPTIVE 0100000000
+#define BARRIER_PREALLOC 0200000000
+
+/*
+ * Flag of sleep_on_barrier_timeout: the timeout is an absolute CLOCK_MONOTONIC time
+ */
+
+#define BARRIER_TIMEOUT_ABS 1
+
+/*
+ * The number of dense synchronization tags of a barrier, which can be used with the mask
+ * system calls and the shared page, and the number of all the tags (the sparse ones can
+ * only be used one at a time)
+ */
+
+#define BARRIER_TAGS 64
+#define BARRIER_TAG_SPACE 65536
+
+/*
+ * Bit of a tag in the masks given to awake_barrier_mask and sleep_on_barrier_mask
+ * and mask selecting all the tags greater than or equal to the given one
+ */
+
+#define BARRIER_TAG_BIT(tag) (1ULL<<(tag))
+#define BARRIER_TAGS_FROM(tag) ((tag)<=0 ? ~0ULL : (tag)>=BARRIER_TAGS ? 0ULL : ~0ULL<<(tag))
+
+/*
+ * File descriptor of "/dev/barrier", opened the first time it is needed and shared by all
+ * the operations of the process (and by its children); returns -1 with errno ENOSYS in case
+ * the device can't be opened, i.e. the module is not inserted
+ */
+
+static inline int barrier_device(void){
+        static int fd=-1;
+        if(fd<0){
+                fd=open("/dev/barrier",O_RDONLY);
+                if(fd<0)
+                        errno=ENOSYS;
+        }
+        return fd;
+}
+
+/*
+ * Issue an ioctl command on the device: returns the value of the command, or -1 with errno set
+ */
+
+static inline int barrier_ioctl(unsigned long cmd,unsigned long arg){
+        int fd=barrier_device();
+        if(fd<0)
+                return -1;
+        return ioctl(fd,cmd,arg);
+}
+
+/*
+ * Operations on the barriers (see "barrier_ioctl.h" and README.md)
+ */
+
+static inline int get_barrier_limit(key_t key,int flags,int per_tag_max){
+        struct barrier_get_arg arg={key,flags,per_tag_max};
+        return barrier_ioctl(BARRIER_IOC_GET,(unsigned long)&arg);
+}
+
+static inline int get_barrier(key_t key,int flags){
+        return get_barrier_limit(key,flags,0);
+}
+
+static inline int release_barrier(int bd){
+        return barrier_ioctl(BARRIER_IOC_RELEASE,bd);
+}
+
+/*
+ * Create a barrier private to the calling process, to synchronize its threads: returns its
+ * identifier, to be used with all the other operations, or -1 with errno set. The barrier is
+ * released by release_local_barrier or as soon as the process exits; its file descriptor is
+ * inherited by the children created with fork(), which then share the barrier until they
+ * close it too (or exec)
+ */
+
+static inline int get_local_barrier(int flags,int per_tag_max){
+        struct barrier_get_arg arg={0,flags,per_tag_max};
+        int fd=barrier_ioctl(BARRIER_IOC_GET_LOCAL,(unsigned long)&arg);
+        return fd<0?-1:BARRIER_LOCAL_BD(fd);
+}
+
+static inline int release_local_barrier(int bd){
+        return close(BARRIER_LOCAL_FD(bd));
+}
+
+static inline int sleep_on_barrier(int bd,int tag){
+        struct barrier_tag_arg arg={bd,tag};
+        return barrier_ioctl(BARRIER_IOC_SLEEP,(unsigned long)&arg);
+}
+
+static inline int awake_barrier(int bd,int tag){
+        struct barrier_tag_arg arg={bd,tag};
+        return barrier_ioctl(BARRIER_IOC_AWAKE,(unsigned long)&arg);
+}
+
+/*
+ * Wake up at most n of the processes sleeping on a tag, in the order they went to sleep:
+ * returns the number of processes woken up
+ */
+
+static inline int awake_barrier_n(int bd,int tag,int n){
+        struct barrier_awake_n_arg arg={bd,tag,n};
+        return barrier_ioctl(BARRIER_IOC_AWAKE_N,(unsigned long)&arg);
+}
+
+static inline int sleep_on_barrier_mask(int bd,unsigned long long mask){
+        struct barrier_mask_arg arg={bd,0,mask};
+        return barrier_ioctl(BARRIER_IOC_SLEEP_MASK,(unsigned long)&arg);
+}
+
+static inline int awake_barrier_mask(int bd,unsigned long long mask){
+        struct barrier_mask_arg arg={bd,0,mask};
+        return barrier_ioctl(BARRIER_IOC_AWAKE_MASK,(unsigned long)&arg);
+}
+
+static inline int set_barrier_threshold(int bd,int tag,int threshold){
+        struct barrier_threshold_arg arg={bd,tag,threshold};
+        return barrier_ioctl(BARRIER_IOC_THRESHOLD,(unsigned long)&arg);
+}
+
+static inline int sleep_on_barrier_timeout(int bd,int tag,const struct timespec* timeout,int flags){
+        struct barrier_timeout_arg arg={bd,tag,flags,0,timeout->tv_sec,timeout->tv_nsec};
+        return barrier_ioctl(BARRIER_IOC_SLEEP_TIMEOUT,(unsigned long)&arg);
+}
+
+/*
+ * Execute "count" operations with a single ioctl: returns the number of entries executed,
+ * the outcome of each of them is in its "result" field
+ */
+
+static inline int barrier_batch(struct barrier_batch_entry* entries,int count){
+        struct barrier_batch_arg arg={(unsigned long)entries,count,0};
+        return barrier_ioctl(BARRIER_IOC_BATCH,(unsigned long)&arg);
+}
+
+/*
+ * Get a file descriptor watching a tag, to be used with poll, select or epoll: it becomes
+ * readable after each awake of the tag and reading it returns the number of awakes since the
+ * last read as an 8-byte integer
+ */
+
+static inline int watch_barrier(int bd,int tag){
+        struct barrier_tag_arg arg={bd,tag};
+        return barrier_ioctl(BARRIER_IOC_WATCH,(unsigned long)&arg);
+}
+
+/*
+ * Page shared with a barrier, mapped read-only from "/dev/barrier" at offset bd*page size:
+ * it holds the generation (number of awakes), the number of sleeping processes and the
+ * number of watching file descriptors of each dense tag, each tag on its own 64-byte
+ * cache line. Programs using it on 32-bit
+ * systems have to be compiled with -D_FILE_OFFSET_BITS=64, since the offset grows with
+ * the barrier id
+ */
+
+struct barrier_shared_tag
+{
+        volatile unsigned int generation;
+        volatile unsigned int sleepers;
+        volatile unsigned int watchers;
+        unsigned int pad[13];
+};
+
+struct barrier_shared
+{
+        struct barrier_shared_tag tags[BARRIER_TAGS];
+};
+
+/*
+ * Map the page shared with the barrier with id bd, which for a local barrier is at offset 0
+ * of its own file descriptor; returns NULL in case of error
+ */
+
+static inline struct barrier_shared* map_barrier(int bd){
+        int fd;
+        void* page;
+        fd=bd<0?BARRIER_LOCAL_FD(bd):barrier_device();
+        if(fd<0)
+                return NULL;
+        page=mmap(NULL,getpagesize(),PROT_READ,MAP_SHARED,fd,bd<0?0:(off_t)bd*getpagesize());
+        return page==MAP_FAILED?NULL:(struct barrier_shared*)page;
+}
+
+/*
+ * Same as awake_barrier, but without entering the kernel when no process is sleeping on
+ * the tag and no file descriptor is watching it: in this case the kernel would return EINVAL
+ */
+
+static inline int awake_barrier_fast(struct barrier_shared* shared,int bd,int tag){
+        if(tag>=0 && tag<BARRIER_TAGS && !shared->tags[tag].sleepers && !shared->tags[tag].watchers){
+                errno=EINVAL;
+                return -1;
+        }
+        return awake_barrier(bd,tag);
+}
+
+/*
+ * Value returned by sleep_on_barrier_fast when the tag has been woken up while spinning
+ */
+
+#define BARRIER_SPUN 1
+
+/*
+ * Same as sleep_on_barrier, but first spin for at most "spins" iterations waiting for the
+ * tag to be woken up by an awake for the processes already sleeping on it: in this case
+ * BARRIER_SPUN is returned without entering the kernel. The process has then only seen the
+ * awake of the processes that were sleeping: it has not been synchronized with them, nor
+ * counted towards the threshold of the tag, so it has to call sleep_on_barrier whenever it
+ * needs to be. Use an adaptive barrier (BARRIER_ADAPTIVE) to spin after being counted
+ */
+
+static inline int sleep_on_barrier_fast(struct barrier_shared* shared,int bd,int tag,int spins){
+        unsigned int generation;
+        int i;
+        if(tag>=0 && tag<BARRIER_TAGS && shared->tags[tag].sleepers){
+                generation=shared->tags[tag].generation;
+                for(i=0;i<spins;i++){
+                        if(shared->tags[tag].generation!=generation)
+                                return BARRIER_SPUN;
+                        __asm__ __volatile__("rep; nop" ::: "memory");
+                }
+        }
+        return sleep_on_barrier(bd,tag);
+}
+
+/*
+ * Nanoseconds elapsed from an arbitrary point in the past, for the programs measuring the
+ * operations on the barriers
+ */
+
+static inline long long now(void){
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC,&ts);
+        return ts.tv_sec*1000000000LL+ts.tv_nsec;
+}
 
 #endif //BARRIERSYNCHRONIZATION_BARRIER_USER_H
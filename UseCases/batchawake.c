@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <linux/ipc.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "barrier_user.h"
+
+#define ROUNDS 1000
+
+/*
+ * Compare the cost of waking up tag 0 of N barriers with one ioctl per barrier against a
+ * single batch of N entries: since no process sleeps on the barriers, the time measured is
+ * mostly the cost of entering the kernel
+ */
+
+int main(int argc, char** argv){
+        int key,barriers,i,round;
+        int* ids;
+        long long start,single,batched;
+        struct barrier_batch_entry* entries;
+        if(argc!=3){
+                printf("Invalid arguments: provide the key of the first barrier as first parameter and number of barriers as second parameter\n");
+                return EINVAL;
+        }
+        key=strtol(argv[1],NULL,10);
+        barriers=strtol(argv[2],NULL,10);
+        if(barriers<=0 || barriers>BARRIER_BATCH_MAX){
+                printf("The number of barriers has to be between 1 and %d\n",BARRIER_BATCH_MAX);
+                return EINVAL;
+        }
+        ids=calloc(barriers,sizeof(int));
+        entries=calloc(barriers,sizeof(struct barrier_batch_entry));
+
+        /*
+         * Get the barriers with a single batch as well
+         */
+
+        for(i=0;i<barriers;i++){
+                entries[i].op=BARRIER_OP_GET;
+                entries[i].key=key+i;
+                entries[i].flags=IPC_CREAT;
+        }
+        if(barrier_batch(entries,barriers)<0){
+                printf("Error while getting barriers:%d\n",errno);
+                return errno;
+        }
+        for(i=0;i<barriers;i++){
+                if(entries[i].result<0){
+                        printf("Error while getting barrier with key %d:%d\n",key+i,-entries[i].result);
+                        return -entries[i].result;
+                }
+                ids[i]=entries[i].result;
+        }
+
+        start=now();
+        for(round=0;round<ROUNDS;round++)
+                for(i=0;i<barriers;i++)
+                        awake_barrier(ids[i],0);
+        single=now()-start;
+
+        for(i=0;i<barriers;i++){
+                entries[i].op=BARRIER_OP_AWAKE;
+                entries[i].bd=ids[i];
+                entries[i].tag=0;
+        }
+        start=now();
+        for(round=0;round<ROUNDS;round++)
+                barrier_batch(entries,barriers);
+        batched=now()-start;
+
+        printf("Barriers:%d one ioctl per awake:%lld ns per awake, one batch:%lld ns per awake\n",
+               barriers,single/ROUNDS/barriers,batched/ROUNDS/barriers);
+
+        for(i=0;i<barriers;i++){
+                entries[i].op=BARRIER_OP_RELEASE;
+                entries[i].bd=ids[i];
+        }
+        barrier_batch(entries,barriers);
+        return 0;
+}
@@ -0,0 +1,45 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <linux/ipc.h>
+#include <errno.h>
+#include "barrier_user.h"
+
+
+int main(int argc, char** argv){
+        int id,key,flags,per_tag_max;
+        if(argc>2){
+                key = strtol(argv[1],NULL,10);
+                per_tag_max = strtol(argv[2],NULL,10);
+                flags=IPC_CREAT;
+                if(argc==4)
+                        flags = strtol(argv[3],NULL,10);
+                printf("Get barrier with key %d, flags %d and at most %d processes sleeping on each tag\n",key,flags,per_tag_max);
+                id=get_barrier_limit(key,flags,per_tag_max);
+                if(id<0) {
+                        switch(errno){
+                                case EINVAL:{
+                                        printf("Error while getting barrier: invalid limit of sleeping processes\n");
+                                        break;
+                                }
+                                case ENOSPC:{
+                                        printf("Error while getting barrier:too many barriers already instantiated\n");
+                                        break;
+                                }
+                                case ENOSYS:{
+                                        printf("Error while getting barrier: \"barrier_module\" not inserted\n");
+                                        break;
+                                }
+                                default:
+                                        printf("Error while getting barrier:%d\n",errno);
+                        }
+                        return errno;
+                }
+                printf("Barrier id:%d\n",id);
+                return 0;
+        }
+        printf("Invalid arguments: at least provide barrier key as first parameter and limit of sleeping processes per tag\n"
+                               "as second parameter (0 for the default one); optionally provide flags as third parameter\n");
+}
@@ -8,22 +8,6 @@
 #include "barrier_user.h"
 #include <signal.h>
 
-int get_barrier(key_t key, int flags){
-        return syscall(nr_get_barrier,key,flags);
-}
-
-int sleep_on_barrier(int bd, int tag){
-        return syscall(nr_sleep_on_barrier,bd,tag);
-}
-
-int awake_barrier(int bd, int tag){
-        return syscall(nr_awake_barrier,bd,tag);
-}
-
-int release_barrier(int md){
-        return syscall(nr_release_barrier,md);
-}
-
 void sighandler(int signum, siginfo_t *info, void *ptr){
         printf("Received signal %d\n", signum);
         printf("Signal originates from process %lu\n",(unsigned long)info->si_pid);
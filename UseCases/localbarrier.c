@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "barrier_user.h"
+
+#define ROUNDS 100000
+#define MAX_THREADS 64
+
+/*
+ * The barriers being compared: a pthread barrier and a local barrier whose tag 0 has a
+ * threshold equal to the number of threads, so the last thread going to sleep on the tag
+ * wakes up all the others, as in "pthread_barrier_wait"
+ */
+
+pthread_barrier_t pbarrier;
+int bd;
+
+void* pthread_rounds(void* arg){
+        int i;
+        for(i=0;i<ROUNDS;i++)
+                pthread_barrier_wait(&pbarrier);
+        return NULL;
+}
+
+void* local_rounds(void* arg){
+        int i;
+        for(i=0;i<ROUNDS;i++)
+                sleep_on_barrier(bd,0);
+        return NULL;
+}
+
+/*
+ * Run the rounds with the given number of threads: returns the average time of a round
+ * in nanoseconds
+ */
+
+long long run(int threads,void* (*rounds)(void*)){
+        pthread_t tids[MAX_THREADS];
+        long long start;
+        int t;
+        start=now();
+        for(t=0;t<threads;t++)
+                pthread_create(&tids[t],NULL,rounds,NULL);
+        for(t=0;t<threads;t++)
+                pthread_join(tids[t],NULL);
+        return (now()-start)/ROUNDS;
+}
+
+/*
+ * Compare a local barrier with "pthread_barrier_t" synchronizing the threads of this process
+ * over and over: the local barrier is not registered in the IPC namespace, and its identifier
+ * is resolved through the file descriptor table of the process instead of the IDR
+ */
+
+int main(int argc, char** argv){
+        int threads;
+        if(argc>2){
+                printf("Invalid arguments: optionally provide the number of threads (at most %d) as first parameter\n",MAX_THREADS);
+                return EINVAL;
+        }
+        threads=argc==2?strtol(argv[1],NULL,10):4;
+        if(threads<=0 || threads>MAX_THREADS){
+                printf("The number of threads has to be between 1 and %d\n",MAX_THREADS);
+                return EINVAL;
+        }
+        bd=get_local_barrier(BARRIER_PREALLOC,0);
+        if(bd==-1){
+                printf("Error while getting local barrier:%d\n",errno);
+                return errno;
+        }
+        if(set_barrier_threshold(bd,0,threads)<0){
+                printf("Error while setting the threshold:%d\n",errno);
+                return errno;
+        }
+        pthread_barrier_init(&pbarrier,NULL,threads);
+        printf("Threads:%d rounds:%d\n",threads,ROUNDS);
+        printf("pthread_barrier_t: %lld ns per round\n",run(threads,pthread_rounds));
+        printf("local barrier:     %lld ns per round\n",run(threads,local_rounds));
+        pthread_barrier_destroy(&pbarrier);
+        release_local_barrier(bd);
+        return 0;
+}
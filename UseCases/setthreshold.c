@@ -0,0 +1,41 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <linux/ipc.h>
+#include <errno.h>
+#include "barrier_user.h"
+
+
+int main(int argc, char** argv){
+        int id,tag,threshold,set;
+        if(argc==4){
+                id = strtol(argv[1],NULL,10);
+                tag = strtol(argv[2],NULL,10);
+                threshold = strtol(argv[3],NULL,10);
+                printf("Setting threshold %d for tag %d of barrier with id %d\n",threshold,tag,id);
+                set=set_barrier_threshold(id,tag,threshold);
+                if(!set) {
+                        printf("Threshold of tag %d of barrier with id %d successfully set\n",tag,id);
+                        return 0;
+                }
+                else{
+                        switch(errno){
+                                case EINVAL:{
+                                        printf("Error while setting threshold of tag %d of barrier with id %d:invalid barrier id, tag or threshold\n",tag,id);
+                                        break;
+                                }
+                                case ENOSYS:{
+                                        printf("Error while setting threshold of tag %d of barrier with id %d: \"barrier_module\" not inserted\n",tag,id);
+                                        break;
+                                }
+                                default:
+                                        printf("Error while setting threshold of tag %d of barrier with id %d:%d\n",tag,id,errno);
+                        }
+                        return errno;
+                }
+        }
+        else
+                printf("Invalid arguments: provide valid barrier ID, synchronization tag and threshold\n");
+}
@@ -0,0 +1,60 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <linux/ipc.h>
+#include <errno.h>
+#include "barrier_user.h"
+#include <signal.h>
+
+void sighandler(int signum, siginfo_t *info, void *ptr){
+        printf("Received signal %d\n", signum);
+        printf("Signal originates from process %lu\n",(unsigned long)info->si_pid);
+}
+
+
+int main(int argc, char** argv){
+        int id,sleep,i;
+        unsigned long long mask;
+        struct sigaction act;
+        memset(&act, 0, sizeof(act));
+        act.sa_sigaction = sighandler;
+        act.sa_flags = SA_SIGINFO;
+        for(i=1;i<32;i++){
+                sigaction(i, &act, NULL);
+        }
+        if(argc==3){
+                id = strtol(argv[1],NULL,10);
+                mask = strtoull(argv[2],NULL,0);
+                printf("PID of current process:%d\n",getpid());
+                printf("Now go to sleep on barrier with id %d on tags with mask %#llx\n",id,mask);
+                sleep=sleep_on_barrier_mask(id,mask);
+                if(sleep<0) {
+                        switch(errno){
+                                case EINTR:{
+                                        printf("Process woken up because of interrupt\n");
+                                        break;
+                                }
+                                case EINVAL:{
+                                        printf("Error while going to sleep on tags with mask %#llx of barrier with id %d: invalid barrier id or mask\n",mask,id);
+                                        break;
+                                }
+                                case ENOSPC:{
+                                        printf("Error while going to sleep on tags with mask %#llx of barrier with id %d: too many processes sleeping on a tag\n",mask,id);
+                                        break;
+                                }
+                                case ENOSYS:{
+                                        printf("Error while going to sleep on tags with mask %#llx of barrier with id %d: \"barrier_module\" not inserted\n",mask,id);
+                                        break;
+                                }
+                                default:
+                                        printf("Could not sleep on tags with mask %#llx of barrier with id %d because of error:%d\n",mask,id,errno);
+                        }
+                        return errno;
+                }
+                printf("Process woken up by another process on tag %d\n",sleep);
+                return 0;
+        }
+        printf("Invalid arguments: provide barrier id as first parameter and mask of tags as second parameter\n");
+}
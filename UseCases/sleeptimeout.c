@@ -0,0 +1,65 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <linux/ipc.h>
+#include <errno.h>
+#include "barrier_user.h"
+#include <signal.h>
+#include <time.h>
+
+void sighandler(int signum, siginfo_t *info, void *ptr){
+        printf("Received signal %d\n", signum);
+        printf("Signal originates from process %lu\n",(unsigned long)info->si_pid);
+}
+
+
+int main(int argc, char** argv){
+        int id,sleep,tag,i;
+        long msec;
+        struct timespec timeout;
+        struct sigaction act;
+        memset(&act, 0, sizeof(act));
+        act.sa_sigaction = sighandler;
+        act.sa_flags = SA_SIGINFO;
+        for(i=1;i<32;i++){
+                sigaction(i, &act, NULL);
+        }
+        if(argc==4){
+                id = strtol(argv[1],NULL,10);
+                tag = strtol(argv[2],NULL,10);
+                msec = strtol(argv[3],NULL,10);
+                timeout.tv_sec = msec/1000;
+                timeout.tv_nsec = (msec%1000)*1000000;
+                printf("PID of current process:%d\n",getpid());
+                printf("Now go to sleep on barrier with id %d on tag %d for at most %ld ms\n",id,tag,msec);
+                sleep=sleep_on_barrier_timeout(id,tag,&timeout,0);
+                if(sleep<0) {
+                        switch(errno){
+                                case EINTR:{
+                                        printf("Process woken up because of interrupt\n");
+                                        break;
+                                }
+                                case ETIMEDOUT:{
+                                        printf("Process woken up because the timeout elapsed\n");
+                                        break;
+                                }
+                                case EINVAL:{
+                                        printf("Error while going to sleep on tag %d of barrier with id %d: invalid barrier id, tag or timeout\n",tag,id);
+                                        break;
+                                }
+                                case ENOSYS:{
+                                        printf("Error while going to sleep on tag %d of barrier with id %d: \"barrier_module\" not inserted\n",tag,id);
+                                        break;
+                                }
+                                default:
+                                        printf("Could not sleep on tag %d of barrier with id %d because of error:%d\n",tag,id,errno);
+                        }
+                        return errno;
+                }
+                printf("Process woken up by another process\n");
+                return 0;
+        }
+        printf("Invalid arguments: provide barrier id as first parameter, tag as second parameter and timeout in milliseconds as third parameter\n");
+}
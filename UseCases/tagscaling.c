@@ -0,0 +1,85 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <linux/ipc.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "barrier_user.h"
+
+#define ITERATIONS 200000
+#define MAX_TAGS 32
+
+/*
+ * Measure how operations on different tags of the same barrier scale with the number of
+ * tags in use: each tag is driven by its own process, pinned to its own CPU, which goes to
+ * sleep on the tag over and over. The threshold of every tag is 1, so each sleep wakes up
+ * the tag in kernel and returns at once: the time measured is the cost of the operation,
+ * including any contention with the processes working on the other tags
+ */
+
+int main(int argc, char** argv){
+        int id,key,tags,max,cpus,t,i;
+        long long start,elapsed;
+        volatile int* go;
+        cpu_set_t set;
+        if(argc<2 || argc>3){
+                printf("Invalid arguments: provide barrier key as first parameter and, optionally, the maximum number of tags (at most %d) as second parameter\n",MAX_TAGS);
+                return EINVAL;
+        }
+        key=strtol(argv[1],NULL,10);
+        max=argc==3?strtol(argv[2],NULL,10):MAX_TAGS;
+        if(max<=0 || max>MAX_TAGS){
+                printf("The number of tags has to be between 1 and %d\n",MAX_TAGS);
+                return EINVAL;
+        }
+        cpus=sysconf(_SC_NPROCESSORS_ONLN);
+        id=get_barrier(key,IPC_CREAT);
+        if(id<0){
+                printf("Error while getting barrier:%d\n",errno);
+                return errno;
+        }
+        for(t=0;t<max;t++)
+                if(set_barrier_threshold(id,t,1)<0){
+                        printf("Error while setting the threshold of tag %d:%d\n",t,errno);
+                        return errno;
+                }
+        go=mmap(NULL,sizeof(int),PROT_READ|PROT_WRITE,MAP_SHARED|MAP_ANONYMOUS,-1,0);
+        printf("%6s %14s %14s\n","tags","ops/s","ns/op per tag");
+        for(tags=1;;tags=tags*2>max?max:tags*2){
+                *go=0;
+                for(t=0;t<tags;t++){
+                        if(!fork()){
+                                CPU_ZERO(&set);
+                                CPU_SET(t%cpus,&set);
+                                sched_setaffinity(0,sizeof(set),&set);
+                                while(!*go)
+                                        ;
+                                for(i=0;i<ITERATIONS;i++)
+                                        sleep_on_barrier(id,t);
+                                exit(0);
+                        }
+                }
+
+                /*
+                 * Give the processes time to get to their CPUs before starting all of them at once
+                 */
+
+                usleep(100000);
+                start=now();
+                *go=1;
+                for(t=0;t<tags;t++)
+                        wait(NULL);
+                elapsed=now()-start;
+                printf("%6d %14.0f %14.1f\n",tags,(double)tags*ITERATIONS*1e9/elapsed,(double)elapsed/ITERATIONS);
+                if(tags==max)
+                        break;
+        }
+        release_barrier(id);
+        return 0;
+}
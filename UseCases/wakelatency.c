@@ -0,0 +1,76 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <linux/ipc.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "barrier_user.h"
+
+#define ROUNDS 10
+
+/*
+ * Measure the time elapsed between the awake of a tag and the moment the last of
+ * the processes sleeping on the tag gets back to execution: the sleepers write the
+ * time of their wake up into an array shared with the parent process
+ *
+ * To compare two versions of the module, insert each of them in turn on the same idle
+ * machine and run the program with the same number of sleepers (e.g. 1, 16, 128 and 1024),
+ * a few times each, comparing the average latencies printed
+ */
+
+int main(int argc, char** argv){
+        int id,key,sleepers,i,round;
+        long long start,last,total;
+        long long* woken;
+        volatile int* ready;
+        if(argc!=3){
+                printf("Invalid arguments: provide barrier key as first parameter and number of sleepers as second parameter\n");
+                return EINVAL;
+        }
+        key=strtol(argv[1],NULL,10);
+        sleepers=strtol(argv[2],NULL,10);
+        id=get_barrier(key,IPC_CREAT);
+        if(id<0){
+                printf("Error while getting barrier:%d\n",errno);
+                return errno;
+        }
+        ready=mmap(NULL,2*sizeof(int)+sleepers*sizeof(long long),PROT_READ|PROT_WRITE,MAP_SHARED|MAP_ANONYMOUS,-1,0);
+        woken=(long long*)(ready+2);
+        total=0;
+        for(round=0;round<ROUNDS;round++){
+                *ready=0;
+                for(i=0;i<sleepers;i++){
+                        if(!fork()){
+                                __sync_fetch_and_add(ready,1);
+                                sleep_on_barrier(id,0);
+                                woken[i]=now();
+                                exit(0);
+                        }
+                }
+
+                /*
+                 * Wait for all the sleepers to be ready and give them some more time to
+                 * actually go to sleep on the barrier
+                 */
+
+                while(*ready<sleepers)
+                        usleep(1000);
+                usleep(100000);
+                start=now();
+                awake_barrier(id,0);
+                for(i=0;i<sleepers;i++)
+                        wait(NULL);
+                last=start;
+                for(i=0;i<sleepers;i++)
+                        if(woken[i]>last)
+                                last=woken[i];
+                total+=last-start;
+        }
+        printf("Sleepers:%d average wake latency of the last sleeper:%lld ns\n",sleepers,total/ROUNDS);
+        release_barrier(id);
+        return 0;
+}
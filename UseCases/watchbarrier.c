@@ -0,0 +1,71 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <linux/ipc.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "barrier_user.h"
+
+#define MAX_EVENTS 64
+
+/*
+ * Watch some tags of a barrier from a single thread with epoll: each tag is watched through
+ * its own file descriptor, whose epoll data is the tag itself, and every awake of a watched
+ * tag is reported until the barrier is released
+ */
+
+int main(int argc, char** argv){
+        int id,tag,fd,epfd,n,i,watched;
+        uint64_t awakes;
+        struct epoll_event event;
+        struct epoll_event events[MAX_EVENTS];
+        if(argc<3){
+                printf("Invalid arguments: provide barrier id as first parameter and the tags to be watched as further parameters\n");
+                return EINVAL;
+        }
+        id=strtol(argv[1],NULL,10);
+        epfd=epoll_create1(EPOLL_CLOEXEC);
+        if(epfd<0){
+                printf("Error while creating epoll instance:%d\n",errno);
+                return errno;
+        }
+        for(i=2;i<argc;i++){
+                tag=strtol(argv[i],NULL,10);
+                fd=watch_barrier(id,tag);
+                if(fd<0){
+                        printf("Error while watching tag %d of barrier with id %d:%d\n",tag,id,errno);
+                        return errno;
+                }
+                memset(&event,0,sizeof(event));
+                event.events=EPOLLIN;
+                event.data.u64=((uint64_t)tag<<32) | (uint32_t)fd;
+                epoll_ctl(epfd,EPOLL_CTL_ADD,fd,&event);
+        }
+        watched=argc-2;
+        printf("Watching %d tags of barrier with id %d\n",watched,id);
+        while(watched){
+                n=epoll_wait(epfd,events,MAX_EVENTS,-1);
+                if(n<0){
+                        if(errno==EINTR)
+                                continue;
+                        printf("Error while waiting for events:%d\n",errno);
+                        return errno;
+                }
+                for(i=0;i<n;i++){
+                        tag=(int)(events[i].data.u64>>32);
+                        fd=(int)(uint32_t)events[i].data.u64;
+                        if(read(fd,&awakes,sizeof(awakes))==sizeof(awakes))
+                                printf("Tag %d woken up %llu times\n",tag,(unsigned long long)awakes);
+                        else if(events[i].events & EPOLLHUP){
+                                printf("Barrier with id %d released, no longer watching tag %d\n",id,tag);
+                                close(fd);
+                                watched--;
+                        }
+                }
+        }
+        close(epfd);
+        return 0;
+}
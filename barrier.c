@@ -17,560 +17,2951 @@
 #include <linux/gfp.h>
 #include <linux/err.h>
 #include <linux/ipc_namespace.h>
+#include <linux/sched.h>
+#include <linux/hrtimer.h>
+#include <linux/time.h>
+#include <linux/uaccess.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/anon_inodes.h>
+#include <linux/poll.h>
+#include <linux/percpu.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/radix-tree.h>
+#include <linux/bitmap.h>
+#include <linux/workqueue.h>
+#include <linux/hash.h>
+#include <linux/rculist.h>
+#include <linux/fdtable.h>
 #include <asm-generic/current.h>
 #include <asm-generic/pgtable.h>
 #include "barrier.h"
+#include "barrier_ioctl.h"
 #include "helper.h"
 
 /*
- * Pointer to the ipc_ids data structure used to keep track of  all the instances
- * of the barrier on the basis of their ids
+ * Diagnostic messages are printed with "pr_debug": they cost nothing unless the module
+ * is compiled with DEBUG defined or, with dynamic debug, until they are enabled at
+ * runtime, e.g. writing "module barrier_module +p" into the file "dynamic_debug/control"
+ * of debugfs. Only the messages about insertion and removal of the module are always
+ * printed
  */
 
-struct ipc_ids* barrier_ids;
+/*
+ * Hash table of the registries of the barriers, one for each IPC namespace having barriers
+ * (see "barrier_ns"): it is read in RCU read-side critical sections and updated holding
+ * the lock below
+ */
+
+struct hlist_head barrier_namespaces[1<<BARRIER_NS_HASH_BITS];
+DEFINE_SPINLOCK(barrier_namespaces_lock);
+
+/*
+ * Operations of the file descriptors of the local barriers (see "barrier_get_local"), which
+ * tell them apart from any other file
+ */
+
+extern struct file_operations barrier_local_fops;
+
+/*
+ * Slab cache of the "barrier_tag" structures: objects are aligned to the cache line
+ * and reused without going through the generic allocator
+ */
+
+struct kmem_cache* barrier_tag_cache;
+
+/*
+ * Per-CPU cumulative counters of the module (see "barrier_stat"): they are incremented
+ * on the local CPU without any lock and summed up only when "/proc/barrier" is read
+ */
+
+DEFINE_PER_CPU(struct barrier_stats,barrier_stats);
+
+#define barrier_stat_inc(stat) this_cpu_inc(barrier_stats.count[stat])
 
 /*
- * Functions to check permission over the barrier: we don't care
- * about permissions, so always return 0
+ * Limits of the module, given when it is inserted: maximum number of barriers existing at
+ * the same time in each IPC namespace, maximum number of processes sleeping on a tag of a barrier (the latter
+ * can be lowered for each barrier when it is created) and maximum number of sparse tags used on a barrier
+ */
+
+int barrier_ids_max=BARRIER_IDS_MAX;
+module_param(barrier_ids_max,int,0444);
+MODULE_PARM_DESC(barrier_ids_max,"Maximum number of barriers existing at the same time in each IPC namespace (at most 32768)");
+
+int barrier_per_tag_max=BARRIER_PER_TAG_MAX;
+module_param(barrier_per_tag_max,int,0444);
+MODULE_PARM_DESC(barrier_per_tag_max,"Maximum number of processes sleeping on a tag of a barrier");
+
+int barrier_sparse_max=BARRIER_SPARSE_MAX;
+module_param(barrier_sparse_max,int,0444);
+MODULE_PARM_DESC(barrier_sparse_max,"Maximum number of sparse tags used on a barrier, 0 to disable the sparse tags");
+
+/*
+ * Minimum number of processes sleeping on a tag for its awake to fan out over the woken
+ * processes (see BARRIER_FANOUT_MIN): it can be changed while the module is inserted, so
+ * it is validated by the function below every time it is set, rather than by "init_module"
+ */
+
+int barrier_fanout_min=BARRIER_FANOUT_MIN;
+
+/*
+ * Set the module parameter "barrier_fanout_min", when the module is inserted or later through
+ * sysfs: a negative value would make every awake fan out
  *
- * @ipcp: permission object to which is function is associated
- * @flag: parameters to this function
+ * @val: the new value, as a string
+ * @kp: the module parameter
+ *
+ * Returns 0 in case of success or -EINVAL in case the value is not a number from 0 to INT_MAX
  */
 
-int barrier_security(struct kern_ipc_perm * ipcp, int flag){
+int barrier_set_fanout_min(const char* val,struct kernel_param* kp){
+        long fanout_min;
+
+        if(!val || strict_strtol(val,0,&fanout_min) || fanout_min<0 || fanout_min>INT_MAX)
+                return -EINVAL;
+        ACCESS_ONCE(*(int*)kp->arg)=fanout_min;
         return 0;
 }
 
+module_param_call(barrier_fanout_min,barrier_set_fanout_min,param_get_int,&barrier_fanout_min,0644);
+MODULE_PARM_DESC(barrier_fanout_min,"Minimum number of sleeping processes for the awake of a tag to fan out, 0 to always wake up all of them at once");
+
 /*
  * Unlock the permission object within a barrier: this means unlocking the
  * permission object and also end the RCU read-side critical section
  *
- * @barrier: pointer to the barrier whose permission object has to be unlocked
+ * @barrier: pointer to the barrier whose permission object has to be unlocked
+ */
+
+void barrier_unlock(struct barrier_struct* barrier){
+        struct kern_ipc_perm* barrier_ipc_perm=&(barrier->barrier_perm);
+        spin_unlock(&(barrier_ipc_perm->lock));
+        rcu_read_unlock();
+}
+
+/*
+ * Lock the permission object within a barrier the caller holds a reference to:
+ * this means starting an RCU read-side critical section and then locking the
+ * permission object. The caller has to check whether the barrier has been
+ * released in the meantime (the field "deleted" of the permission object)
+ *
+ * @barrier: pointer to the barrier whose permission object has to be locked
+ */
+
+void barrier_lock(struct barrier_struct* barrier){
+        struct kern_ipc_perm* barrier_ipc_perm=&(barrier->barrier_perm);
+        rcu_read_lock();
+        spin_lock(&(barrier_ipc_perm->lock));
+}
+
+/*
+ * RCU callback freeing the memory of a barrier: the structures of its tags, the page shared
+ * with user space and finally the barrier itself
+ *
+ * @head: the "rcu" field of the barrier
+ *
+ * Returns nothing
+ */
+
+void barrier_free_rcu(struct rcu_head* head){
+        struct barrier_struct* barrier=container_of(head,struct barrier_struct,rcu);
+        struct barrier_tag* barrier_tag;
+        int i;
+
+        for(i=0;i<BARRIER_TAGS;i++)
+                if(barrier->tags[i])
+                        kmem_cache_free(barrier_tag_cache,barrier->tags[i]);
+
+        /*
+         * Remove the sparse tags from the radix tree one at a time, which also frees its nodes
+         */
+
+        while(radix_tree_gang_lookup(&barrier->sparse,(void**)&barrier_tag,BARRIER_TAGS,1)){
+                radix_tree_delete(&barrier->sparse,barrier_tag->tag);
+                kmem_cache_free(barrier_tag_cache,barrier_tag);
+        }
+
+        /*
+         * The shared page is actually freed only when no process maps it anymore
+         */
+
+        free_page((unsigned long)barrier->shared);
+        ipc_rcu_putref(barrier);
+}
+
+/*
+ * Drop a reference to the given barrier: if this was the last one, the barrier has
+ * been released and no process is sleeping on it anymore, so its memory can be freed.
+ * Readers walking the IDR under RCU (see "/proc/barrier") may still be looking at the
+ * barrier and at its tags, hence the memory is freed only after a grace period
+ *
+ * @barrier: barrier whose reference has to be dropped
+ *
+ * Returns nothing
+ */
+
+void barrier_put(struct barrier_struct* barrier){
+        if(atomic_dec_and_test(&barrier->refcount))
+                call_rcu(&barrier->rcu,barrier_free_rcu);
+}
+
+/*
+ * Find the registry of the barriers of the given IPC namespace. A registry whose last reference
+ * has been dropped is skipped, since it is about to be removed from the hash table
+ *
+ * Function has to be invoked within an RCU read-side critical section, which keeps the
+ * registry from being freed
+ *
+ * @ns: the IPC namespace
+ *
+ * Returns the registry or NULL in case the namespace has no barriers
+ */
+
+struct barrier_ns* barrier_ns_find(struct ipc_namespace* ns){
+        struct barrier_ns* registry;
+        struct hlist_node* pos;
+
+        hlist_for_each_entry_rcu(registry,pos,&barrier_namespaces[hash_ptr(ns,BARRIER_NS_HASH_BITS)],hash)
+                if(registry->ns==ns && atomic_read(&registry->refcount))
+                        return registry;
+        return NULL;
+}
+
+/*
+ * RCU callback freeing the memory of a registry
+ *
+ * @head: the "rcu" field of the registry
+ *
+ * Returns nothing
+ */
+
+void barrier_ns_free_rcu(struct rcu_head* head){
+        struct barrier_ns* registry=container_of(head,struct barrier_ns,rcu);
+
+        idr_destroy(&registry->ids.ipcs_idr);
+        kfree(registry);
+}
+
+/*
+ * Get a reference to the registry of the barriers of the given IPC namespace, creating it in
+ * case the namespace has none: a new registry takes a reference to the namespace, so that
+ * the namespace isn't freed (and its address reused) while it still has barriers
+ *
+ * @ns: the IPC namespace
+ * @create: whether a registry has to be created in case the namespace has none
+ *
+ * Returns the registry, -EINVAL in case it doesn't exist and @create is not set or -ENOMEM
+ */
+
+struct barrier_ns* barrier_ns_get(struct ipc_namespace* ns,int create){
+
+        /*
+         * The registry and, in case a new one is allocated, the one inserted by another
+         * process of the namespace in the meantime
+         */
+
+        struct barrier_ns* registry;
+        struct barrier_ns* found;
+
+        /*
+         * Bucket of the hash table of the keys being initialized
+         */
+
+        int i;
+
+        rcu_read_lock();
+        registry=barrier_ns_find(ns);
+        if(registry && atomic_inc_not_zero(&registry->refcount)){
+                rcu_read_unlock();
+                return registry;
+        }
+        rcu_read_unlock();
+        if(!create)
+                return ERR_PTR(-EINVAL);
+
+        registry=kmalloc(sizeof(*registry),GFP_KERNEL);
+        if(!registry)
+                return ERR_PTR(-ENOMEM);
+        ipc_init_ids(&registry->ids);
+        for(i=0;i<(1<<BARRIER_KEY_HASH_BITS);i++)
+                INIT_HLIST_HEAD(&registry->keys[i]);
+        atomic_set(&registry->refcount,1);
+        registry->dead=0;
+        registry->ns=ns;
+
+        /*
+         * Look the namespace up again holding the lock on the hash table, since another process
+         * of the namespace may have created its registry meanwhile
+         */
+
+        rcu_read_lock();
+        spin_lock(&barrier_namespaces_lock);
+        found=barrier_ns_find(ns);
+        if(found && atomic_inc_not_zero(&found->refcount)){
+                spin_unlock(&barrier_namespaces_lock);
+                rcu_read_unlock();
+                kfree(registry);
+                return found;
+        }
+        get_ipc_ns(ns);
+        hlist_add_head_rcu(&registry->hash,&barrier_namespaces[hash_ptr(ns,BARRIER_NS_HASH_BITS)]);
+        spin_unlock(&barrier_namespaces_lock);
+        rcu_read_unlock();
+
+        pr_debug("BARRIER_MODULE->New registry of barriers at address %p for the namespace at address %p\n",registry,ns);
+
+        return registry;
+}
+
+/*
+ * Drop a reference to the given registry: if this was the last one, the namespace has no barriers
+ * left and nobody is using the registry, so it is removed from the hash table, the reference to
+ * the namespace is dropped and the registry is freed after a grace period
+ *
+ * Function may sleep, since dropping the reference to the namespace may free it
+ *
+ * @registry: the registry
+ *
+ * Returns nothing
+ */
+
+void barrier_ns_put(struct barrier_ns* registry){
+        if(!atomic_dec_and_lock(&registry->refcount,&barrier_namespaces_lock))
+                return;
+        hlist_del_rcu(&registry->hash);
+        spin_unlock(&barrier_namespaces_lock);
+
+        pr_debug("BARRIER_MODULE->Freeing registry of barriers at address %p\n",registry);
+
+        if(barrier_put_ipc_ns)
+                barrier_put_ipc_ns(registry->ns);
+        call_rcu(&registry->rcu,barrier_ns_free_rcu);
+}
+
+/*
+ * Find the barrier with the given key (other than IPC_PRIVATE) among the ones of the given
+ * registry, skipping the ones already released
+ *
+ * Function has to be invoked within an RCU read-side critical section, which keeps the barrier
+ * found from being freed but not from being released meanwhile, unless the mutex of the registry
+ * is held too
+ *
+ * @registry: the registry
+ * @key: the key
+ *
+ * Returns the barrier or NULL in case the registry has no barrier with the given key
+ */
+
+struct barrier_struct* barrier_find_key(struct barrier_ns* registry,key_t key){
+        struct barrier_struct* barrier;
+        struct hlist_node* pos;
+
+        hlist_for_each_entry_rcu(barrier,pos,&registry->keys[hash_32((u32)key,BARRIER_KEY_HASH_BITS)],key_hash)
+                if(barrier->barrier_perm.key==key && !barrier->barrier_perm.deleted)
+                        return barrier;
+        return NULL;
+}
+
+/*
+ * Copy the generation and the number of sleeping processes of the given tag into the page
+ * shared with user space, so that processes can check them without entering the kernel
+ *
+ * Function has to be invoked holding the lock on the tag
+ *
+ * @barrier: barrier containing the tag
+ * @barrier_tag: structure representing the tag
+ *
+ * Returns nothing
+ */
+
+void publishtag(struct barrier_struct* barrier,struct barrier_tag* barrier_tag){
+        if(barrier_tag->tag>=BARRIER_TAGS)
+                return;
+        ACCESS_ONCE(barrier->shared->tags[barrier_tag->tag].sleepers)=barrier_tag->counter;
+        ACCESS_ONCE(barrier->shared->tags[barrier_tag->tag].watchers)=barrier_tag->watchers;
+        ACCESS_ONCE(barrier->shared->tags[barrier_tag->tag].generation)=(u32)barrier_tag->generation;
+}
+
+/*
+ * Set or clear the bit of the given tag in the bitmap of the tags having sleeping processes:
+ * sparse tags have no bit, so the bitmap is left unchanged for them. The bit is only written
+ * when it actually changes, since the bitmap is shared by all the tags of the barrier
+ *
+ * Functions have to be invoked holding the lock on the tag
+ *
+ * @barrier: barrier containing the tag
+ * @tag: a legal tag
+ *
+ * Return nothing
+ */
+
+void setactive(struct barrier_struct* barrier,int tag){
+        if(tag<BARRIER_TAGS && !test_bit(tag,barrier->active))
+                set_bit(tag,barrier->active);
+}
+
+void clearactive(struct barrier_struct* barrier,int tag){
+        if(tag<BARRIER_TAGS && test_bit(tag,barrier->active))
+                clear_bit(tag,barrier->active);
+}
+
+/*
+ * Read the bitmap of the tags having sleeping processes as a 64-bit mask, where the bit of
+ * each tag is BARRIER_TAG_BIT(tag): the bitmap is made of one or two words, depending on the
+ * size of a long, and each of its bits is read atomically, which is all the callers need
+ *
+ * @barrier: the barrier
+ *
+ * Returns the mask of the active tags
+ */
+
+u64 activetags(struct barrier_struct* barrier){
+        u64 active=0;
+        int i;
+
+        for(i=0;i<BITS_TO_LONGS(BARRIER_TAGS);i++)
+                active|=(u64)ACCESS_ONCE(barrier->active[i])<<(i*BITS_PER_LONG);
+
+        return active;
+}
+
+/*
+ * Structure of the given tag, if it has ever been allocated: dense tags are found by indexing
+ * the array of the barrier, sparse ones by looking up its radix tree
+ *
+ * Function has to be invoked in an RCU read-side critical section or holding the lock on the
+ * barrier: once allocated, a structure lives as long as the barrier
+ *
+ * @barrier: barrier containing the tag
+ * @tag: a legal tag
+ *
+ * Returns the structure of the tag or NULL
+ */
+
+struct barrier_tag* lookuptag(struct barrier_struct* barrier,int tag){
+        if(tag<BARRIER_TAGS)
+                return rcu_dereference(barrier->tags[tag]);
+        return radix_tree_lookup(&barrier->sparse,tag);
+}
+
+/*
+ * Register a new process sleeping on the given tag: the counter of the tag is incremented
+ * and the bit of the tag is set in the bitmap of the barrier
+ *
+ * Function has to be invoked holding the lock on the tag
+ *
+ * @barrier: barrier containing the tag
+ * @barrier_tag: structure representing the tag
+ *
+ * Returns nothing
+ */
+
+void arrivetag(struct barrier_struct* barrier,struct barrier_tag* barrier_tag){
+        barrier_tag->counter++;
+        setactive(barrier,barrier_tag->tag);
+        publishtag(barrier,barrier_tag);
+}
+
+/*
+ * Unregister a process that is no longer sleeping on the given tag (because of a signal or
+ * a timeout) even though the tag has not been woken up: the counter of the tag is decreased
+ * and, if no process nor file descriptor is left waiting, the bit of the tag is cleared in
+ * the bitmap of the barrier
+ *
+ * Function has to be invoked holding the lock on the tag
+ *
+ * @barrier: barrier containing the tag
+ * @barrier_tag: structure representing the tag
+ *
+ * Returns nothing
+ */
+
+void leavetag(struct barrier_struct* barrier,struct barrier_tag* barrier_tag){
+        barrier_tag->counter--;
+        if(!barrier_tag->counter && !barrier_tag->watchers)
+                clearactive(barrier,barrier_tag->tag);
+        publishtag(barrier,barrier_tag);
+}
+
+/*
+ * Allocate and initialize the "barrier_tag" structure of the given tag
+ *
+ * @tag: tag associated to the structure
+ *
+ * Returns the new structure or NULL in case there's not enough memory left
+ */
+
+struct barrier_tag* newtag(int tag){
+        struct barrier_tag* barrier_tag;
+
+        barrier_tag=kmem_cache_alloc(barrier_tag_cache,GFP_KERNEL);
+        if(!barrier_tag)
+                return NULL;
+
+        /*
+         * Initialize the "barrier_tag" object:
+         *
+         * 1- set the "counter" field to 0
+         * 2- set the tag field
+         * 3- disable the automatic awake of the tag
+         * 4- set the generation to 0
+         * 5- initialize the wait queue shared by the sleeping processes and the lock of the tag
+         */
+
+        barrier_tag->counter=0;
+        barrier_tag->tag=tag;
+        barrier_tag->threshold=0;
+        barrier_tag->generation=0;
+        init_waitqueue_head(&(barrier_tag->queue));
+        spin_lock_init(&barrier_tag->lock);
+        barrier_tag->watchers=0;
+        init_waitqueue_head(&(barrier_tag->poll_queue));
+        barrier_tag->awakes=0;
+        return barrier_tag;
+}
+
+/*
+ * Get the "barrier_tag" structure of the given tag, allocating it in case no process has
+ * ever gone to sleep on the tag: the allocation may sleep, so the RCU read-side critical
+ * section is left meanwhile, while a reference keeps the barrier alive. The new structure
+ * is installed holding the lock on the barrier, unless another process did it first
+ *
+ * Function has to be invoked in an RCU read-side critical section, which is entered again
+ * before the function returns, both in case of success and of error. The lock on the tag is
+ * not taken: the caller has to check whether the barrier has been released holding it
+ *
+ * @barrier: barrier containing the tag
+ * @tag: tag whose structure has to be returned
+ *
+ * Returns the structure of the tag, -ENOMEM in case there's not enough memory left, -ENOSPC
+ * in case the barrier already uses "barrier_sparse_max" sparse tags or -EINVAL in case the
+ * barrier has been released while the structure was being allocated
+ */
+
+struct barrier_tag* gettag(struct barrier_struct* barrier,int tag){
+        struct barrier_tag* barrier_tag;
+
+        /*
+         * Return value and whether the nodes of the radix tree needed by a sparse tag have
+         * been preallocated
+         */
+
+        struct barrier_tag* ret;
+        int preloaded=0;
+
+        barrier_tag=lookuptag(barrier,tag);
+        if(barrier_tag)
+                return barrier_tag;
+
+        /*
+         * Don't even allocate the structure if the barrier already uses as many sparse tags as
+         * allowed: the limit is checked again holding the lock
+         */
+
+        if(tag>=BARRIER_TAGS && ACCESS_ONCE(barrier->sparse_count)>=barrier_sparse_max)
+                return ERR_PTR(-ENOSPC);
+
+        /*
+         * A barrier whose last reference is gone has already been released
+         */
+
+        if(!atomic_inc_not_zero(&barrier->refcount))
+                return ERR_PTR(-EINVAL);
+        rcu_read_unlock();
+        barrier_tag=newtag(tag);
+
+        /*
+         * A sparse tag also needs the nodes of the radix tree, which can't be allocated while
+         * holding the lock: they are preallocated on the current CPU, with preemption disabled
+         * until "radix_tree_preload_end"
+         */
+
+        if(barrier_tag && tag>=BARRIER_TAGS){
+                if(radix_tree_preload(GFP_KERNEL)){
+                        kmem_cache_free(barrier_tag_cache,barrier_tag);
+                        barrier_tag=NULL;
+                }
+                else
+                        preloaded=1;
+        }
+        barrier_lock(barrier);
+
+        /*
+         * The barrier has been released meanwhile: its tags can't be used anymore. Otherwise
+         * install the structure, unless another process allocated it while the lock was released
+         * or the barrier already uses as many sparse tags as allowed
+         */
+
+        if(barrier->barrier_perm.deleted)
+                ret=ERR_PTR(-EINVAL);
+        else if(!barrier_tag)
+                ret=ERR_PTR(-ENOMEM);
+        else{
+                ret=lookuptag(barrier,tag);
+                if(!ret && tag<BARRIER_TAGS){
+                        rcu_assign_pointer(barrier->tags[tag],barrier_tag);
+                        ret=barrier_tag;
+                        barrier_tag=NULL;
+                }
+                else if(!ret){
+                        if(barrier->sparse_count<barrier_sparse_max){
+                                radix_tree_insert(&barrier->sparse,tag,barrier_tag);
+                                barrier->sparse_count++;
+                                ret=barrier_tag;
+                                barrier_tag=NULL;
+                        }
+                        else
+                                ret=ERR_PTR(-ENOSPC);
+                }
+        }
+
+        /*
+         * Only release the lock on the barrier, staying in the RCU read-side critical section
+         * entered by "barrier_lock": the reference can then be dropped, since the memory of the
+         * barrier is only freed after the critical section is over
+         */
+
+        spin_unlock(&barrier->barrier_perm.lock);
+        if(preloaded)
+                radix_tree_preload_end();
+        if(barrier_tag)
+                kmem_cache_free(barrier_tag_cache,barrier_tag);
+        barrier_put(barrier);
+
+        return ret;
+}
+
+/*
+ * Allocate and initialize the structure of a new barrier, which is not reachable by any
+ * process yet (see "newbarrier" and "barrier_get_local")
+ *
+ * @params: flags and key associated to the new barrier
+ * @per_tag_max: maximum number of processes sleeping on each tag of the new barrier, already
+ *               checked against the module parameter "barrier_per_tag_max"
+ *
+ * Returns the barrier or -ENOMEM
+ */
+
+struct barrier_struct* allocbarrier(struct ipc_params* params,int per_tag_max){
+
+        /*
+         * The basic structure for the barrier we are creating
+         */
+
+        struct barrier_struct *barrier;
+
+        /*
+         * Index used to initialize the tags of the barrier
+         */
+
+        int i;
+
+        /*
+         * The key requested by the user-space process
+         */
+
+        key_t key = params->key;
+
+        /*
+         * The flags requested by the user-space process
+         */
+
+        int barrierflags = params->flg;
+
+        /*
+         * Allocate the memory for the barrier: the barrier_structure is preceded by
+         * an RCU header which is necessary to protect our barrier during RCU read-side
+         * critical sections and then to update it after these critical sections are
+         * over in case some other process meanwhile (concurrently) updated them
+         */
+
+        barrier = ipc_rcu_alloc(sizeof(*barrier));
+
+        pr_debug("BARRIER_MODULE->Address of the barrier with key %d:%p\n",key,barrier);
+
+        /*
+         * Return error in case there's not enough memory left
+         * for the barrier
+         */
+
+        if (!barrier) {
+                return ERR_PTR(-ENOMEM);
+        }
+
+        /*
+         * Allocate the page shared with user space, holding the generation and the number of
+         * sleeping processes of each tag
+         */
+
+        barrier->shared=(struct barrier_shared*)get_zeroed_page(GFP_KERNEL);
+        if(!barrier->shared){
+                ipc_rcu_putref(barrier);
+                return ERR_PTR(-ENOMEM);
+        }
+
+        /*
+         * Set the key of the kern_ipc_perm  within the new barrier
+         */
+
+        barrier->barrier_perm.key = key;
+
+        /*
+         * Set the mode (flag) of the kern_ipc_perm  within the new barrier:
+         * we make a bitwise AND with the flag "S_IRWXUGO", which grants
+         * read,write and execute permissions to user, group and others
+         */
+
+        barrier->barrier_perm.mode=barrierflags & S_IRWXUGO;
+
+        /*
+         * Keep the flags that determine the behaviour of the barrier
+         */
+
+        barrier->flags=barrierflags & (BARRIER_ADAPTIVE | BARRIER_PREALLOC);
+
+        /*
+         * The limit of sleeping processes of each tag, already checked against the module parameter
+         */
+
+        barrier->per_tag_max=per_tag_max;
+        barrier->wait_ns=0;
+
+        /*
+         * Set to NULL the "security" field of the kern_ipc_perm structure,
+         * since this is only used in SELinux
+         */
+
+        barrier->barrier_perm.security=NULL;
+
+        /*
+         * None of the tags has sleeping processes yet: their structures are allocated
+         * when they are first used, or right now for the dense tags if the barrier has
+         * been created with BARRIER_PREALLOC. The radix tree of the sparse tags is only
+         * updated holding the lock, with its nodes preallocated (see "gettag"). The only
+         * reference to the barrier is the one of the IDR, or of the file descriptor of a
+         * local barrier
+         */
+
+        for(i=0;i<BARRIER_TAGS;i++)
+                barrier->tags[i]=NULL;
+        INIT_RADIX_TREE(&barrier->sparse,GFP_ATOMIC);
+        barrier->sparse_count=0;
+        if(barrier->flags & BARRIER_PREALLOC){
+                for(i=0;i<BARRIER_TAGS;i++){
+                        barrier->tags[i]=newtag(i);
+                        if(!barrier->tags[i]){
+                                barrier_free_rcu(&barrier->rcu);
+                                return ERR_PTR(-ENOMEM);
+                        }
+                }
+        }
+        bitmap_zero(barrier->active,BARRIER_TAGS);
+        atomic_set(&barrier->refcount,1);
+        atomic_set(&barrier->mask_sleepers,0);
+        init_waitqueue_head(&barrier->mask_queue);
+
+        return barrier;
+}
+
+/*
+ * Create a new barrier in the given registry (see "get_barrier")
+ *
+ * @registry: registry of the namespace the barrier belongs to
+ * @params: flags and key associated to the new barrier
+ * @per_tag_max: maximum number of processes sleeping on each tag of the new barrier
+ *
+ * Returns the IPC identifier of the newly created barrier or some error code in case
+ * something goes wrong.
+ *
+ * This function is called holding a reference to the registry and its mutex as writer,
+ * after the nodes of its IDR have been preallocated
+ *
+ */
+
+int newbarrier(struct barrier_ns* registry, struct ipc_params* params, int per_tag_max){
+
+        /*
+         * The unique IPC identifier of the new barrier; recall that
+         * this id is unique within a "data structure type scope",i.e.
+         * there may be an IPC message queue or IPC semaphore with
+         * the same id as this barrier we are creating
+         */
+
+        int id;
+
+        /*
+         * The basic structure for the barrier we are creating
+         */
+
+        struct barrier_struct *barrier;
+
+        /*
+         * The key requested by the user-space process
+         */
+
+        key_t key = params->key;
+
+        barrier=allocbarrier(params,per_tag_max);
+        if(IS_ERR(barrier))
+                return PTR_ERR(barrier);
+
+        /*
+         * Get a new id for the newly created barrier instance.
+         * The permission object (kern_ipc_perm) of the barrier is initialized
+         * and locked.
+         *
+         * The id returned is the one assigned by the IDR object within the ipc_ids
+         * structure but the actual IPC identifier is written into the permission
+         * object and is equal to
+         *
+         * IPC_id=SEQ_MULTIPLIER * seq + id;
+         *
+         * where "seq" is the sequence number of the barrier, "id" is the identifier
+         * returned by IDR and SEQ_MULTIPLIER is a constant equal to IPCMNI (32768)
+         *
+         * The ipc_ids structure is the one of the registry of the namespace. The third
+         * parameter determines the limit for the number of ids used for the barrier: in
+         * the IPC subsystem this parameter is taken from the ipc_namespace, we take it
+         * from the module parameter "barrier_ids_max", which applies to each namespace
+         * on its own
+         */
+
+        barrier->registry=registry;
+        id = ipc_addid(&registry->ids,&barrier->barrier_perm,barrier_ids_max);
+
+        /*
+         * If the id returned is negative, this is a sign that something went wrong,
+         * so the barrier object has to be removed, together with the rcu_head structure
+         * associated -> the function below decreases the counter of references to the
+         * RCU-protected barrier structure (the counter is stored within the rcu header
+         * prepended to the barrier structure) and then checks if this counter is null,
+         * i.e. if no other process has references to this data structure: if that's the
+         * case, the "call_rcu" function from the RCU API is invoked, so the structure will
+         * be removed as soon as all the RCU read-side critical sections connected to it
+         * will be over
+         *
+         * The error code is then returned.
+         */
+
+        if(id<0){
+                barrier_free_rcu(&barrier->rcu);
+                return id;
+        }
+
+        /*
+         * The new instance of barrier is complete, so we can index it by key and
+         * unlock it to make it accessible to all the other processes; it keeps the
+         * registry of its namespace alive until it is released
+         */
+
+        if(key!=IPC_PRIVATE)
+                hlist_add_head_rcu(&barrier->key_hash,&registry->keys[hash_32((u32)key,BARRIER_KEY_HASH_BITS)]);
+        else
+                INIT_HLIST_NODE(&barrier->key_hash);
+        atomic_inc(&registry->refcount);
+
+        barrier_unlock(barrier);
+
+        /*
+         * Return the assigned IPC identifier
+         */
+
+        return barrier->barrier_perm.id;
+}
+
+/*
+ * Return a pointer to the "barrier_tag" structure corresponding to the given tag within the given
+ * barrier, holding the lock on the tag; returns NULL if no process is sleeping on the tag and no
+ * file descriptor is watching it
+ *
+ * @barrier: the barrrier where the tag has to be searched
+ * @tag: tag to search for
+ *
+ * This has to be called only after the tag value has been verified to be valid, i.e.
+ * 0<=tag<BARRIER_TAG_SPACE, so here we don't need further checks
+ *
+ * Also this has to be called in an RCU read-side critical section, which keeps the barrier and
+ * its tags from being freed
+ *
+ */
+
+struct barrier_tag* findtag(struct barrier_struct* barrier,int tag){
+
+        /*
+         * Only the lock of the tag is taken, so processes working on other tags of the same
+         * barrier don't get in the way
+         */
+
+        struct barrier_tag* barrier_tag;
+
+        barrier_tag=lookuptag(barrier,tag);
+        if(!barrier_tag)
+                return NULL;
+
+        spin_lock(&barrier_tag->lock);
+        if(barrier_tag->counter || barrier_tag->watchers)
+                return barrier_tag;
+        spin_unlock(&barrier_tag->lock);
+
+        return NULL;
+}
+
+/*
+ * Find the barrier with the given IPC identifier without locking it: the IDR is looked up the
+ * same way "ipc_lock_check" does, i.e. the index is the identifier modulo IPCMNI and the
+ * sequence number has to match the quotient. The identifier of a local barrier is instead
+ * BARRIER_LOCAL_BD(fd), where fd is its file descriptor in the calling process: the barrier
+ * is then taken straight from the file (see "barrier_get_local")
+ *
+ * Function has to be invoked within an RCU read-side critical section, which keeps the
+ * barrier from being freed (see "barrier_put") but not from being released meanwhile
+ *
+ * @bd: IPC identifier of the barrier
+ *
+ * Returns the barrier or NULL in case no barrier has the given identifier
+ */
+
+struct barrier_struct* barrier_find_rcu(int bd){
+        struct barrier_ns* registry;
+        struct kern_ipc_perm* perm;
+        struct file* file;
+
+        if(bd<0){
+                file=bd<-1 ? fcheck(BARRIER_LOCAL_FD(bd)) : NULL;
+                if(!file || file->f_op!=&barrier_local_fops)
+                        return NULL;
+                return file->private_data;
+        }
+
+        registry=barrier_ns_find(current->nsproxy->ipc_ns);
+        if(!registry)
+                return NULL;
+        perm=idr_find(&registry->ids.ipcs_idr,bd%IPCMNI);
+        if(!perm || perm->deleted || bd/IPCMNI!=perm->seq)
+                return NULL;
+
+        return container_of(perm,struct barrier_struct,barrier_perm);
+}
+
+/*
+ * Check without taking any lock whether some process may be sleeping on the given tag of the
+ * barrier with the given IPC identifier (or some file descriptor watching it): the bitmap of
+ * the barrier is read for a dense tag, the counters of the tag for a sparse one. Both are only
+ * updated holding the lock on the tag, so a tag found empty had no waiter at some point during the call,
+ * which is all an awake has to know to return without doing anything
+ *
+ * @bd: IPC identifier of the barrier
+ * @tag: a legal tag
+ *
+ * Returns -EINVAL in case no barrier has the given identifier, 0 in case no process is sleeping
+ * on the tag and 1 otherwise
+ */
+
+int peektag(int bd,int tag){
+        struct barrier_struct* barrier;
+        struct barrier_tag* barrier_tag;
+        int ret;
+
+        rcu_read_lock();
+        barrier=barrier_find_rcu(bd);
+        if(!barrier)
+                ret=-EINVAL;
+        else if(tag<BARRIER_TAGS)
+                ret=test_bit(tag,barrier->active) ? 1 : 0;
+        else{
+                barrier_tag=radix_tree_lookup(&barrier->sparse,tag);
+                ret=(barrier_tag && (ACCESS_ONCE(barrier_tag->counter) || ACCESS_ONCE(barrier_tag->watchers))) ? 1 : 0;
+        }
+        rcu_read_unlock();
+
+        return ret;
+}
+
+/*
+ * Step of a fanned out awake: wake up the first BARRIER_FANOUT processes of the wait queue of
+ * the given tag that went to sleep before the last awake, marking each of them so that it
+ * wakes up the next ones in its turn. The processes are queued in arrival order, so the scan
+ * stops at the first process that went to sleep after the awake, i.e. whose generation is
+ * the current one: the processes of the new synchronization phase are never woken up
+ *
+ * Function can be invoked without holding the lock on the tag: the reference to the
+ * barrier held by the calling process keeps the tag alive
+ *
+ * @barrier_tag: structure representing the tag
+ *
+ * Returns nothing
+ */
+
+void barrier_cascade(struct barrier_tag* barrier_tag){
+
+        /*
+         * Current and next entry of the wait queue, the corresponding waiting process and the
+         * number of processes woken up so far
+         */
+
+        wait_queue_t* curr;
+        wait_queue_t* next;
+        struct barrier_waiter* waiter;
+        int woken=0;
+
+        /*
+         * Flags saved by the lock of the wait queue
+         */
+
+        unsigned long flags;
+
+        spin_lock_irqsave(&barrier_tag->queue.lock,flags);
+        list_for_each_entry_safe(curr,next,&barrier_tag->queue.task_list,task_list){
+                waiter=container_of(curr,struct barrier_waiter,wait);
+                if(waiter->generation==ACCESS_ONCE(barrier_tag->generation))
+                        break;
+                waiter->cascade=1;
+                curr->func(curr,TASK_INTERRUPTIBLE,0,NULL);
+                if(++woken==BARRIER_FANOUT)
+                        break;
+        }
+        spin_unlock_irqrestore(&barrier_tag->queue.lock,flags);
+}
+
+/*
+ * This function wakes up all the processes sleeping on the synchronization level corresponding
+ * to the given barrier_tag structure and then marks the tag as having no sleeping process, so that
+ * the structure can be reused for the next synchronization phase of the tag
+ *
+ * Function has to be invoked holding the lock on the tag
+ *
+ * @barrier: barrier containing the tag
+ * @barrier_tag: structure representing the tag to be woken up
+ *
+ * Returns nothing
+ */
+
+void awake_tag(struct barrier_struct* barrier,struct barrier_tag* barrier_tag){
+
+        /*
+         * Whether the awake fans out over the woken processes, decided on the number of
+         * processes sleeping on the tag, and the module parameter it is compared with, read
+         * only once since it can be changed meanwhile
+         */
+
+        int fanout,fanout_min;
+
+        /*
+         * Bit of the tag, the key of the wake up of the processes sleeping on a set of tags
+         */
+
+        u64 bit;
+
+        pr_debug("BARRIER_MODULE->Waking up tag:%d\n",barrier_tag->tag);
+        barrier_stat_inc(BARRIER_STAT_AWAKES);
+
+        /*
+         * It is necessary to increment the generation of the tag and then call the "wake_up_all"
+         * function on the wait queue shared by all the processes synchronized on this tag.
+         *
+         * In this way, as soon as the sleeping processes wake up, they realize that the generation
+         * they recorded is no longer the current one, so they go back to the TASK_RUNNING state and
+         * are removed from the wait queue
+         */
+
+        barrier_tag->generation++;
+        fanout_min=ACCESS_ONCE(barrier_fanout_min);
+
+        /*
+         * The file descriptors watching the tag count the awakes, but not the release of the
+         * barrier, which only wakes up the processes sleeping on the tag (see "awake_all")
+         */
+
+        if(!barrier->barrier_perm.deleted)
+                barrier_tag->awakes++;
+        fanout=fanout_min && barrier_tag->counter>=fanout_min;
+
+        /*
+         * No process is sleeping on the tag anymore: reset the counter and clear the bit of the tag
+         * in the bitmap of the barrier, so that the next process going to sleep on the tag starts a
+         * new synchronization phase
+         */
+
+        barrier_tag->counter=0;
+        if(!barrier_tag->watchers)
+                clearactive(barrier,barrier_tag->tag);
+        publishtag(barrier,barrier_tag);
+
+        /*
+         * Wake up all the processes sleeping on the wait queue of the tag: the lock of the wait
+         * queue is taken only once, no matter how many processes are sleeping on it.
+         *
+         * On a large tag, waking up all of them serializes every wake up on the current CPU while
+         * holding the lock on the tag: only the first processes of the queue are woken up
+         * instead, and each of them wakes up the next ones as soon as it runs (see
+         * "barrier_cascade"), so the time until the last process runs grows with the logarithm
+         * of the number of processes rather than linearly
+         */
+
+        if(fanout)
+                barrier_cascade(barrier_tag);
+        else
+                wake_up_all(&barrier_tag->queue);
+
+        /*
+         * The file descriptors watching the tag are now readable
+         */
+
+        if(barrier_tag->watchers)
+                wake_up_all(&barrier_tag->poll_queue);
+
+        /*
+         * Also wake up the processes sleeping on a set of tags including this one, if any: the
+         * bit of the tag is the key of the wake up, so the others are not even woken up (see
+         * "barrier_mask_wake"). Such a process is counted before it takes the lock of any of its
+         * tags, so it can't be missed by an awake coming after it recorded the generation of this
+         * tag. Sparse tags can't be part of a set
+         */
+
+        if(barrier_tag->tag<BARRIER_TAGS && atomic_read(&barrier->mask_sleepers)){
+                bit=BARRIER_TAG_BIT(barrier_tag->tag);
+                __wake_up(&barrier->mask_queue,TASK_INTERRUPTIBLE,0,&bit);
+        }
+
+        pr_debug("BARRIER_MODULE->Woken up tag:%d\n",barrier_tag->tag);
+}
+
+/*
+ * Check whether the number of processes sleeping on the given tag has reached the threshold
+ * of the tag (counting barrier): if so, wake up all of them
+ *
+ * Function has to be invoked holding the lock on the tag
+ *
+ * @barrier: barrier containing the tag
+ * @barrier_tag: structure representing the tag
+ *
+ * Returns 1 if the tag has been woken up, 0 otherwise
+ */
+
+int checkthreshold(struct barrier_struct* barrier,struct barrier_tag* barrier_tag){
+        if(!barrier_tag->threshold || barrier_tag->counter<barrier_tag->threshold)
+                return 0;
+        awake_tag(barrier,barrier_tag);
+        return 1;
+}
+
+/*
+ * Wake up at most the given number of processes sleeping on the given tag, in the order they
+ * went to sleep, leaving the others asleep: the generation of the tag doesn't change, so each
+ * released process is marked by "barrier_wake" and removed from the counter of the tag. In
+ * case the number covers all the processes sleeping on the tag, the whole tag is woken up
+ * by "awake_tag", which also releases the processes spinning or sleeping on a set of tags
+ *
+ * Function has to be invoked holding the lock on the tag
+ *
+ * @barrier: barrier containing the tag
+ * @barrier_tag: structure representing the tag
+ * @n: maximum number of processes to be woken up, greater than 0
+ *
+ * Returns the number of processes woken up
+ */
+
+int awake_tag_n(struct barrier_struct* barrier,struct barrier_tag* barrier_tag,int n){
+
+        /*
+         * Key of the wake up, counting the processes released
+         */
+
+        struct barrier_wake_key wake_key;
+
+        if(n>=barrier_tag->counter){
+                wake_key.released=barrier_tag->counter;
+                awake_tag(barrier,barrier_tag);
+                return wake_key.released;
+        }
+
+        /*
+         * Only the first n exclusive waiters of the queue are woken up: fewer processes may be
+         * released, since the counter also includes the ones spinning on an adaptive barrier or
+         * sleeping on a set of tags, which are not in the queue of the tag
+         */
+
+        wake_key.generation=barrier_tag->generation;
+        wake_key.released=0;
+        __wake_up(&barrier_tag->queue,TASK_INTERRUPTIBLE,n,&wake_key);
+        barrier_tag->counter-=wake_key.released;
+        publishtag(barrier,barrier_tag);
+
+        pr_debug("BARRIER_MODULE->Woken up %d processes of tag:%d\n",wake_key.released,barrier_tag->tag);
+        return wake_key.released;
+}
+
+/*
+ * Wake up all the processes sleeping on the tags of the given barrier selected by the given
+ * mask: tags having no sleeping process nor watching file descriptor are skipped. The lock of
+ * each tag is taken in turn, so the awake of a tag is atomic but the set of tags is not
+ *
+ * Function has to be invoked in an RCU read-side critical section
+ *
+ * @barrier: barrier containing the tags
+ * @mask: bitmap of the tags to be woken up
+ *
+ * Returns the number of tags that have been woken up
+ */
+
+int awake_mask(struct barrier_struct* barrier,u64 mask){
+
+        /*
+         * Tag whose processes have to be woken up, its structure and number of tags woken up
+         */
+
+        int tag,woken=0;
+        struct barrier_tag* barrier_tag;
+
+        /*
+         * Only the selected tags having at least one sleeping process have to be woken up
+         */
+
+        mask&=activetags(barrier);
+
+        for(tag=0;tag<BARRIER_TAGS;tag++)
+                if(mask & BARRIER_TAG_BIT(tag)){
+                        barrier_tag=findtag(barrier,tag);
+                        if(!barrier_tag)
+                                continue;
+                        awake_tag(barrier,barrier_tag);
+                        spin_unlock(&barrier_tag->lock);
+                        woken++;
+                }
+
+        return woken;
+}
+
+/*
+ * Wake up the processes sleeping on the given tag of a released barrier: the awake counts as
+ * none for the file descriptors watching the tag (see "awake_tag"), which are only woken up to
+ * find out that the barrier has been released. A tag without sleeping processes is left as it is
+ *
+ * @barrier: the released barrier
+ * @barrier_tag: structure representing the tag
+ *
+ * Returns nothing
+ */
+
+void releasetag(struct barrier_struct* barrier,struct barrier_tag* barrier_tag){
+        spin_lock(&barrier_tag->lock);
+        if(barrier_tag->counter)
+                awake_tag(barrier,barrier_tag);
+        else if(barrier_tag->watchers)
+                wake_up_all(&barrier_tag->poll_queue);
+        spin_unlock(&barrier_tag->lock);
+}
+
+/*
+ * Wake up all the processes sleeping on any tag of the given barrier, dense or sparse, visiting
+ * the radix tree a batch of tags at a time. The lock of every tag whose structure has been
+ * allocated is taken, whether the tag has waiters or not: a process going to sleep on the tag
+ * then either has already been registered on it, and it is woken up here, or it finds the
+ * barrier released once it gets the lock
+ *
+ * Function has to be invoked after the barrier has been marked as released holding its lock:
+ * no tag structure is installed from then on (see "gettag"), so the lock on the barrier itself
+ * is not needed to visit them
+ *
+ * @barrier: the barrier
+ *
+ * Returns nothing
+ */
+
+void awake_all(struct barrier_struct* barrier){
+
+        /*
+         * Batch of structures found in the radix tree, their number and the first tag of the
+         * next batch
+         */
+
+        struct barrier_tag* found[16];
+        int i,n;
+        unsigned long next=BARRIER_TAGS;
+
+        for(i=0;i<BARRIER_TAGS;i++)
+                if(barrier->tags[i])
+                        releasetag(barrier,barrier->tags[i]);
+
+        while((n=radix_tree_gang_lookup(&barrier->sparse,(void**)found,next,16))){
+                for(i=0;i<n;i++)
+                        releasetag(barrier,found[i]);
+                next=found[n-1]->tag+1;
+        }
+}
+
+/*
+ * Work item completing the release of a barrier already removed from the IDR: wake up the
+ * processes sleeping on each of its tags and then drop the reference of the IDR. Waking up
+ * every tag of a barrier may take a while, so it is done here rather than holding the mutex
+ * of the ipc_ids structure, which would stall the creation and the release of any other barrier
+ *
+ * @work: the "release_work" field of the barrier
+ *
+ * Returns nothing
+ */
+
+void barrier_release_work(struct work_struct* work){
+        struct barrier_struct* barrier=container_of(work,struct barrier_struct,release_work);
+
+        awake_all(barrier);
+
+        /*
+         * The memory assigned to the barrier is freed as soon as the processes that were
+         * sleeping on it have left
+         */
+
+        barrier_put(barrier);
+}
+
+/*
+ * Remove the barrier object associated to the given permission object:
+ *
+ * 1-mark the barrier as released, so that no process goes to sleep on it anymore
+ * 2-remove the corresponding entries from the hash table of the keys and from the IDR object
+ *   of the registry of its namespace
+ * 3-queue the work item waking up all the processes sleeping on the barrier, which then drops
+ *   the reference of the IDR to the barrier (see "barrier_release_work")
+ *
+ * Only the first two steps are done holding the mutex of the ipc_ids structure, so releasing
+ * a barrier doesn't keep the other barriers from being created or released for longer than
+ * the removal of its identifier
+ *
+ * @perm: permission object of the barrier to be removed
+ *
+ * This function is called holding a reference to the registry of the barrier, the mutex of
+ * its ipc_ids structure and the lock of the permission object of the barrier to be released
+ */
+
+void freebarrier(struct kern_ipc_perm* perm){
+
+        /*
+         * Pointer to barrier to be removed
+         */
+
+        struct barrier_struct* to_be_removed;
+
+        /*
+         * Get the barrier corresponding to the given permission object
+         */
+
+        to_be_removed=container_of(perm,struct barrier_struct,barrier_perm);
+
+        pr_debug("BARRIER_MODULE->Releasing barrier with id %d at address %p\n",perm->id,to_be_removed);
+
+        /*
+         * Mark the barrier as released before waking up its tags, so that processes that didn't
+         * make it to register on a tag before its lock is taken by the work item find out they
+         * have to give up (see "awake_all"); "ipc_rmid" marks it again
+         */
+
+        perm->deleted=1;
+
+        /*
+         * Stop the association between the IPC identifier (provided by the idr of the
+         * ipc_ids data structure) and the permission object of the barrier: now it's
+         * no longer reachable using the IPC identifier
+         */
+
+        pr_debug("BARRIER_MODULE->Before removing id %d from idr\n",perm->id);
+
+        if(!hlist_unhashed(&to_be_removed->key_hash))
+                hlist_del_rcu(&to_be_removed->key_hash);
+        ipc_rmid(&to_be_removed->registry->ids,perm);
+
+        pr_debug("BARRIER_MODULE->Removed id %d from idr\n",perm->id);
+
+        /*
+         * Release the lock on the permission object
+         */
+
+        barrier_unlock(to_be_removed);
+
+        pr_debug("BARRIER_MODULE->Unlocked barrier with id %d\n",perm->id);
+
+        /*
+         * Drop the reference of the barrier to the registry: the caller holds one too, so
+         * the registry is not freed while its mutex is held
+         */
+
+        barrier_ns_put(to_be_removed->registry);
+
+        /*
+         * Wake up the processes sleeping on the barrier and drop the reference of the IDR
+         * out of this context: the work item owns that reference from now on
+         */
+
+        INIT_WORK(&to_be_removed->release_work,barrier_release_work);
+        schedule_work(&to_be_removed->release_work);
+
+        pr_debug("BARRIER_MODULE->Removed barrier with id %d\n",perm->id);
+}
+
+/*
+ * Release all the barriers of the given registry, as "release_barrier" would do
+ *
+ * The IDR can't be walked with "idr_for_each", since releasing a barrier removes it from the
+ * IDR, which may free the layers the walk is visiting: as "free_ipcs" does for the other IPC
+ * objects, the identifiers are looked up one at a time with "idr_find" until as many barriers
+ * as were in use have been found
+ *
+ * @registry: the registry
+ *
+ * Returns the number of barriers released
+ *
+ * This function is called holding a reference to the registry and the mutex of its ipc_ids
+ * structure as writer
+ */
+
+int freebarriers(struct barrier_ns* registry){
+
+        /*
+         * Permission object of the barrier being released, number of barriers to be released,
+         * number of barriers released so far and next identifier to be looked up
+         */
+
+        struct kern_ipc_perm* perm;
+        int in_use,total,next_id;
+
+        in_use=registry->ids.in_use;
+        for(total=0,next_id=0;total<in_use;next_id++){
+                perm=idr_find(&registry->ids.ipcs_idr,next_id);
+                if(perm==NULL)
+                        continue;
+
+                pr_debug("BARRIER_MODULE->Barrier id :%d\n",perm->id);
+
+                /*
+                 * Acquire the lock on the permission object and release the barrier, which
+                 * drops the lock
+                 */
+
+                rcu_read_lock();
+                spin_lock(&perm->lock);
+                freebarrier(perm);
+                total++;
+        }
+        return total;
+}
+
+/*
+ * Remove the registries of the barriers of all the IPC namespaces
+ *
+ * For each registry, it is necessary to acquire the mutex of its ipc_ids as writer and then
+ * remove all the instance of barriers, each corresponding to an IPC identifier stored in the
+ * idr object. The registry is freed as soon as the reference taken here is dropped, since its
+ * barriers no longer hold any
+ */
+
+void remove_ids(void){
+
+        /*
+         * Registry being emptied and bucket of the hash table being visited
+         */
+
+        struct barrier_ns* registry;
+        int i;
+
+        for(i=0;i<(1<<BARRIER_NS_HASH_BITS);i++){
+                for(;;){
+
+                        /*
+                         * Take a reference to the first registry of the bucket: registries
+                         * whose last reference has been dropped are no longer in the bucket
+                         */
+
+                        spin_lock(&barrier_namespaces_lock);
+                        if(hlist_empty(&barrier_namespaces[i])){
+                                spin_unlock(&barrier_namespaces_lock);
+                                break;
+                        }
+                        registry=hlist_entry(barrier_namespaces[i].first,struct barrier_ns,hash);
+                        atomic_inc(&registry->refcount);
+                        spin_unlock(&barrier_namespaces_lock);
+
+                        /*
+                         * Acquire the mutex on the ipc_ids structure of the registry because we are
+                         * going to remove all the entries from its IDR object
+                         */
+
+                        down_write(&registry->ids.rw_mutex);
+
+                        /*
+                         * Release the barriers registered with the idr of the ipc_ids structure
+                         *
+                         * SHOULD NOT RELEASE ANY: actually we wait for barriers to be release before
+                         * allowing the removal of the module, so when we get here all barrier instances should
+                         * have already been released.
+                         */
+
+                        freebarriers(registry);
+
+                        up_write(&registry->ids.rw_mutex);
+                        barrier_ns_put(registry);
+                }
+        }
+
+        pr_debug("BARRIER_MODULE->All barriers removed\n");
+}
+
+/*
+ * Whether the registry of the given namespace has to be visited by "barrier_ns_reap": the initial
+ * namespace is never freed, and without IPC namespaces the registries hold no reference to it,
+ * which is the only one anyway
+ *
+ * @ns: the IPC namespace
+ *
+ * Returns 1 in case the registry has to be visited, 0 otherwise
+ */
+
+int barrier_ns_reapable(struct ipc_namespace* ns){
+        return barrier_put_ipc_ns && ns!=barrier_init_ipc_ns;
+}
+
+/*
+ * Release the barriers of the IPC namespaces whose processes have all exited: the registry of
+ * a namespace keeps a reference to it, so a namespace left with barriers would never be freed,
+ * together with its barriers, and the module could never be removed. A namespace whose only
+ * reference left is the one of its registry has no process left to use its barriers, nor any
+ * way to get a new one, so its barriers are released as "release_barrier" would do, which in
+ * turn frees the registry and the namespace
+ *
+ * The kernel doesn't tell modules when a namespace loses its last process: the only notifier
+ * of the IPC namespaces is not exported and only runs once the namespace is freed, which the
+ * reference of the registry prevents. The registries are polled instead, by the delayed work
+ * item below every BARRIER_NS_REAP_SECONDS seconds, as long as the registry of any namespace
+ * other than the initial one exists (see "get_barrier"): the barriers of an exited namespace
+ * outlive it for up to that long, or longer in case something else holds a reference to it
+ *
+ * @work: the delayed work item of the function
+ *
+ * Returns nothing
+ */
+
+void barrier_ns_reap(struct work_struct* work);
+
+DECLARE_DELAYED_WORK(barrier_ns_reap_work,barrier_ns_reap);
+
+void barrier_ns_reap(struct work_struct* work){
+
+        /*
+         * Registry being visited, bucket of the hash table being visited, whether a registry to
+         * be reaped has been found in the bucket and number of barriers it had
+         */
+
+        struct barrier_ns* registry;
+        struct hlist_node* pos;
+        int i,found,released;
+
+        for(i=0;i<(1<<BARRIER_NS_HASH_BITS);i++){
+                do{
+
+                        /*
+                         * Take a reference to a registry of the bucket whose namespace has no
+                         * other reference, marking it so that it is only reaped once
+                         */
+
+                        found=0;
+                        spin_lock(&barrier_namespaces_lock);
+                        hlist_for_each_entry(registry,pos,&barrier_namespaces[i],hash)
+                                if(!registry->dead && barrier_ns_reapable(registry->ns) && atomic_read(&registry->ns->count)==1){
+                                        registry->dead=1;
+                                        atomic_inc(&registry->refcount);
+                                        found=1;
+                                        break;
+                                }
+                        spin_unlock(&barrier_namespaces_lock);
+                        if(!found)
+                                break;
+
+                        pr_debug("BARRIER_MODULE->Reaping registry of barriers at address %p of an exited namespace\n",registry);
+
+                        /*
+                         * Release all the barriers of the registry (see "remove_ids"), each of which
+                         * holds a reference to the module (see "get_barrier")
+                         */
+
+                        down_write(&registry->ids.rw_mutex);
+                        released=freebarriers(registry);
+                        up_write(&registry->ids.rw_mutex);
+                        barrier_ns_put(registry);
+                        while(released--)
+                                module_put(THIS_MODULE);
+                }while(found);
+        }
+
+        /*
+         * Visit the registries again later, unless none is left to be visited: the next one
+         * created schedules the work item again
+         */
+
+        found=0;
+        spin_lock(&barrier_namespaces_lock);
+        for(i=0;i<(1<<BARRIER_NS_HASH_BITS) && !found;i++)
+                hlist_for_each_entry(registry,pos,&barrier_namespaces[i],hash)
+                        if(!registry->dead && barrier_ns_reapable(registry->ns)){
+                                found=1;
+                                break;
+                        }
+        spin_unlock(&barrier_namespaces_lock);
+        if(found)
+                schedule_delayed_work(&barrier_ns_reap_work,BARRIER_NS_REAP_SECONDS*HZ);
+}
+
+/*
+ * SYSTEM CALL KERNEL SERVICE ROUTINES - start
+ *
+ * The operations on the barriers, invoked by the ioctl commands of the device "/dev/barrier"
+ * (see "barrier_ioctl") with their arguments already copied from user space:
+ *
+ * 1 - sys_get_barrier
+ * 2 - sys_release_barrier
+ * 3 - sys_sleep_on_barrier
+ * 4 - sys_awake_barrier
+ * 5 - sys_awake_barrier_mask
+ * 6 - sys_sleep_on_barrier_mask
+ * 7 - sys_set_barrier_threshold
+ * 8 - sys_sleep_on_barrier_timeout
+ * 9 - sys_get_barrier_limit
+ * 10 - sys_awake_barrier_n
+ */
+
+/*
+ * Wake function of the processes sleeping on the wait queue of a tag: "awake_tag" wakes up all
+ * of them without a key, while "awake_barrier_n" passes a "barrier_wake_key" and wakes up at
+ * most N of them, each one being marked as released. A process of the current phase is always
+ * reported as woken up, so that a process already running (because of a signal or a timeout)
+ * but still queued is released and counted anyway
+ *
+ * A process of a previous phase is only in the queue because a fanned out awake hasn't reached
+ * it yet: it is woken up without being counted, and it carries on the fanned out awake
+ *
+ * @wait: entry of the process in the wait queue
+ * @mode: state of the processes to be woken up
+ * @sync: whether the wake up is synchronous
+ * @key: NULL, or the "barrier_wake_key" of "awake_barrier_n"
+ *
+ * Returns 1 if the process counts as woken up, 0 otherwise
+ */
+
+int barrier_wake(wait_queue_t* wait,unsigned mode,int sync,void* key){
+
+        /*
+         * Sleeping process and key of the wake up
+         */
+
+        struct barrier_waiter* waiter=container_of(wait,struct barrier_waiter,wait);
+        struct barrier_wake_key* wake_key=key;
+
+        if(wake_key){
+                if(waiter->generation!=wake_key->generation){
+                        waiter->cascade=1;
+                        autoremove_wake_function(wait,mode,sync,NULL);
+                        return 0;
+                }
+                waiter->released=1;
+                wake_key->released++;
+        }
+        autoremove_wake_function(wait,mode,sync,NULL);
+
+        return 1;
+}
+
+/*
+ * Put the current process to sleep on the wait queue of the given tag until the generation of
+ * the tag changes, the process is released by "awake_barrier_n", a signal comes or, in case an
+ * expiration time is given, the time expires: the expiration is handled by a high resolution
+ * timer (hrtimer) on the CLOCK_MONOTONIC clock. The process is queued as an exclusive waiter
+ * at the tail of the wait queue, so the processes are released in the order they arrived
+ *
+ * @barrier_tag: structure representing the tag
+ * @waiter: entry of the process, holding the generation of the tag when it went to sleep
+ * @expires: expiration time, NULL to sleep without timeout
+ * @mode: HRTIMER_MODE_REL if the expiration time is relative to the current time,
+ *        HRTIMER_MODE_ABS if it is an absolute value of the CLOCK_MONOTONIC clock
+ *
+ * Returns 0 if the tag has been woken up, -ERESTARTSYS if a signal came, -ETIMEDOUT if the
+ * expiration time elapsed
+ */
+
+int barrier_wait(struct barrier_tag* barrier_tag,struct barrier_waiter* waiter,ktime_t* expires,enum hrtimer_mode mode){
+
+        /*
+         * Timer that wakes up the process when the expiration time elapses: its "task" field
+         * is set to NULL by the timer callback
+         */
+
+        struct hrtimer_sleeper timeout;
+
+        /*
+         * Return value
+         */
+
+        int ret=0;
+
+        /*
+         * Start the timer, allowing the usual slack of the process
+         */
+
+        if(expires){
+                hrtimer_init_on_stack(&timeout.timer,CLOCK_MONOTONIC,mode);
+                hrtimer_init_sleeper(&timeout,current);
+                hrtimer_set_expires_range_ns(&timeout.timer,*expires,current->timer_slack_ns);
+                hrtimer_start_expires(&timeout.timer,mode);
+                if(!hrtimer_active(&timeout.timer))
+                        timeout.task=NULL;
+        }
+
+        /*
+         * Same loop as "wait_event_interruptible", also checking whether the timer expired
+         */
+
+        for(;;){
+                prepare_to_wait_exclusive(&barrier_tag->queue,&waiter->wait,TASK_INTERRUPTIBLE);
+                if(barrier_tag->generation!=waiter->generation || waiter->released)
+                        break;
+                if(signal_pending(current)){
+                        ret=-ERESTARTSYS;
+                        break;
+                }
+                if(expires && !timeout.task){
+                        ret=-ETIMEDOUT;
+                        break;
+                }
+                schedule();
+        }
+        finish_wait(&barrier_tag->queue,&waiter->wait);
+
+        /*
+         * The mark of a fanned out awake is set before the process is removed from the queue,
+         * which "finish_wait" may have checked without taking the lock of the queue
+         */
+
+        smp_rmb();
+
+        if(expires){
+                hrtimer_cancel(&timeout.timer);
+                destroy_hrtimer_on_stack(&timeout.timer);
+        }
+
+        return ret;
+}
+
+/*
+ * Spin waiting for the given tag of an adaptive barrier to be woken up, before going to sleep
+ * on it: the process spins for at most twice the average time processes recently waited on
+ * the barrier, and it doesn't spin at all if this average exceeds BARRIER_SPIN_MAX_NS. The
+ * process also stops spinning if a signal comes or another process needs the CPU
+ *
+ * @barrier: barrier containing the tag
+ * @barrier_tag: structure representing the tag
+ * @generation: generation of the tag when the process went to sleep on it
+ *
+ * Returns 1 if the tag has been woken up while spinning, 0 otherwise
+ */
+
+int barrier_spin(struct barrier_struct* barrier,struct barrier_tag* barrier_tag,unsigned long generation){
+
+        /*
+         * Maximum time to spin and time the process started spinning
+         */
+
+        unsigned long limit;
+        ktime_t start;
+
+        limit=ACCESS_ONCE(barrier->wait_ns);
+        if(limit>BARRIER_SPIN_MAX_NS)
+                return 0;
+        limit=min_t(unsigned long,2*limit,BARRIER_SPIN_MAX_NS);
+
+        start=ktime_get();
+        while(ACCESS_ONCE(barrier_tag->generation)==generation){
+                if(need_resched() || signal_pending(current) || ktime_to_ns(ktime_sub(ktime_get(),start))>limit)
+                        return 0;
+                cpu_relax();
+        }
+
+        return 1;
+}
+
+/*
+ * Update the average time processes waited on an adaptive barrier with the time the current
+ * process waited: this is an exponentially weighted moving average, where the last sample
+ * weighs 1/8
+ *
+ * @barrier: the barrier
+ * @start: time the process went to sleep on the barrier
+ *
+ * Returns nothing
+ */
+
+void barrier_tune(struct barrier_struct* barrier,ktime_t start){
+
+        /*
+         * Time the process waited, limited to one second so that a single long phase doesn't
+         * take too long to be forgotten
+         */
+
+        unsigned long sample;
+        unsigned long wait_ns;
+
+        sample=(unsigned long)min_t(s64,ktime_to_ns(ktime_sub(ktime_get(),start)),NSEC_PER_SEC);
+        wait_ns=ACCESS_ONCE(barrier->wait_ns);
+        ACCESS_ONCE(barrier->wait_ns)=wait_ns-wait_ns/8+sample/8;
+}
+
+/*
+ * Put the current process to sleep on barrier with given IPC identifier on the queue
+ * corresponding to the given tag
+ *
+ * @bd: IPC identifier of the barrier that the process wants to use in order to synchronize
+ *      with other processes
+ * @tag: index of specific queue of the barrier onto which the process wants to sleep
+ * @expires: expiration time of the sleep, NULL to sleep until the tag is woken up
+ * @mode: whether the expiration time is relative (HRTIMER_MODE_REL) or absolute (HRTIMER_MODE_ABS)
+ *
+ * Returns an error code in case something went wrong, -EINTR in case the process has
+ * been woken up because it has received a signal, -ETIMEDOUT in case the expiration time
+ * elapsed, 0 otherwise. A process whose tag is woken up while a signal comes or the time
+ * expires is released like all the other processes sleeping on the tag, so 0 is returned
+ */
+
+long do_sleep_on_barrier(int bd,int tag,ktime_t* expires,enum hrtimer_mode mode){
+
+        /*
+         * Return value of this system call
+         */
+
+        int ret;
+
+        /*
+         * Barrier associated to the given IPC identifier (if valid)
+         */
+
+        struct barrier_struct* barrier;
+
+        /*
+         * Structure corresponding to the given tag within the barrier associated
+         * to the given IPC identifier (if exists)
+         */
+
+        struct barrier_tag* barrier_tag;
+
+        /*
+         * Entry of the process in the wait queue of the tag, recording the generation of the tag
+         * when the process goes to sleep on it
+         */
+
+        struct barrier_waiter waiter;
+
+        /*
+         * Time the process goes to sleep on an adaptive barrier
+         */
+
+        ktime_t start;
+
+        pr_debug("System call sys_sleep_on_barrier invoked with params: barrier descriptor=%d tag=%d\n",bd,tag);
+
+        /*
+         * Check if the provided tag is valid (0<=tag<BARRIER_TAG_SPACE):
+         * if not, return -EINVAL
+         */
+
+        if(tag<0 || tag>=BARRIER_TAG_SPACE) {
+                ret=-EINVAL;
+                pr_debug("System call sys_sleep_on_barrier returned this value:%d\n",ret);
+                return ret;
+        }
+
+        /*
+         * Look the barrier up without taking its lock: the RCU read-side critical section keeps it
+         * from being freed until the process holds the lock on the tag
+         */
+
+        rcu_read_lock();
+        barrier=barrier_find_rcu(bd);
+        if(!barrier){
+                rcu_read_unlock();
+                ret=-EINVAL;
+                pr_debug("System call sys_sleep_on_barrier returned this value:%d\n",ret);
+                return ret;
+        }
+
+        /*
+         * Get the "barrier_tag" structure of the given tag, allocating it if this is the first time
+         * the tag is used (never for barriers created with BARRIER_PREALLOC)
+         */
+
+        barrier_tag=gettag(barrier,tag);
+        if(IS_ERR(barrier_tag)){
+                rcu_read_unlock();
+                ret=PTR_ERR(barrier_tag);
+                pr_debug("System call sys_sleep_on_barrier returned this value:%d\n",ret);
+                return ret;
+        }
+
+        /*
+         * From now on only the lock of the tag is held, so processes working on other tags of the
+         * barrier don't get in the way. The barrier may have been released in the meantime: the
+         * release takes the lock of each tag after marking the barrier, so in case the mark is not
+         * there yet the process is woken up by the release
+         */
+
+        spin_lock(&barrier_tag->lock);
+        if(barrier->barrier_perm.deleted){
+                spin_unlock(&barrier_tag->lock);
+                rcu_read_unlock();
+                ret=-EINVAL;
+                pr_debug("System call sys_sleep_on_barrier returned this value:%d\n",ret);
+                return ret;
+        }
+
+        /*
+         * Check if the limit of sleeping processes for the given tag has been reached:if so, return
+         * -ENOSPC (no space left) error code and unlock the tag
+         */
+
+        if(barrier_tag->counter>=barrier->per_tag_max){
+                spin_unlock(&barrier_tag->lock);
+                rcu_read_unlock();
+                ret=-ENOSPC;
+                barrier_stat_inc(BARRIER_STAT_ENOSPC);
+                pr_debug("System call sys_sleep_on_barrier returned this value:%d\n",ret);
+                return ret;
+        }
+        barrier_stat_inc(BARRIER_STAT_SLEEPS);
+
+        /*
+         * In case the process is the last one expected on a counting tag, it wakes up all the
+         * processes sleeping on the tag and goes back to user space without sleeping: it is
+         * counted by the awake without registering on the tag, so the bitmap of the barrier,
+         * shared by all the tags, is not even written when no other process is sleeping on it
+         */
+
+        if(barrier_tag->threshold && barrier_tag->counter+1>=barrier_tag->threshold){
+                barrier_tag->counter++;
+                awake_tag(barrier,barrier_tag);
+                spin_unlock(&barrier_tag->lock);
+                rcu_read_unlock();
+                pr_debug("System call sys_sleep_on_barrier returned this value:%d\n",0);
+                return 0;
+        }
+
+        /*
+         * Register the process on the tag (if no process was sleeping on the tag, the current process
+         * starts a new synchronization phase of the tag), record the current generation of the tag
+         * and take a reference to the barrier, so that it is not freed while the process is still
+         * using the wait queue of the tag: the barrier has not been released yet, so the reference
+         * of the IDR is still there
+         */
+
+        arrivetag(barrier,barrier_tag);
+        init_wait(&waiter.wait);
+        waiter.wait.func=barrier_wake;
+        waiter.generation=barrier_tag->generation;
+        waiter.released=0;
+        waiter.cascade=0;
+        atomic_inc(&barrier->refcount);
+
+        /*
+         * Release the lock on the tag
+         */
+
+        spin_unlock(&barrier_tag->lock);
+        rcu_read_unlock();
+
+        /*
+         * Put the current process to sleep on the wait queue of the tag: it is woken up when the
+         * generation of the barrier_tag structure is incremented by another process, or when it
+         * is among the first processes of the queue released by "awake_barrier_n"
+         *
+         * Also we want the process to exit from the wait queue when an interrupt comes or the
+         * expiration time (if any) elapses
+         *
+         * The return value is -ERESTARTSYS if a signal came to wake up the process, -ETIMEDOUT
+         * if the time expired, 0 if it is waken up because the sleeping condition evaluated to true
+         */
+
+        if(barrier->flags & BARRIER_ADAPTIVE){
+
+                /*
+                 * On adaptive barriers, first spin for a while: if the tag is woken up in the
+                 * meantime, the process doesn't go to sleep at all
+                 */
+
+                start=ktime_get();
+                if(barrier_spin(barrier,barrier_tag,waiter.generation))
+                        ret=0;
+                else
+                        ret=barrier_wait(barrier_tag,&waiter,expires,mode);
+                if(!ret)
+                        barrier_tune(barrier,start);
+        }
+        else
+                ret=barrier_wait(barrier_tag,&waiter,expires,mode);
+
+        /*
+         * In case of interrupt or timeout, the generation of the tag tells whether the process has
+         * been woken up in the meantime, since it can't change without the lock on the tag:
+         *
+         * 1- if it is still the one recorded by the process, the process is no longer sleeping on
+         *    the tag, so the counter of the barrier_tag structure has to be decreased
+         * 2- otherwise the tag has been woken up (or the barrier released, which wakes up all the
+         *    tags) and the process has already been counted by the awake, so it has been released
+         *    like all the other processes of its synchronization phase and 0 is returned
+         *
+         * The same holds for a process released by "awake_barrier_n", which marks it holding the
+         * lock on the tag
+         */
+
+        if(ret){
+                spin_lock(&barrier_tag->lock);
+                if(barrier_tag->generation==waiter.generation && !waiter.released)
+                        leavetag(barrier,barrier_tag);
+                else
+                        ret=0;
+                spin_unlock(&barrier_tag->lock);
+        }
+
+        /*
+         * Return -EINTR if the system call gets interrupted, because -ERESTARTSYS would not
+         * be visible to the User Process and is used by the kernel for internal use to specify
+         * whether an interrupted system call should be reissued after the signal handler
+         * termination
+         */
+
+        if(ret==-ERESTARTSYS){
+                ret=-EINTR;
+                barrier_stat_inc(BARRIER_STAT_EINTR);
+        }
+
+        /*
+         * A process woken up by a fanned out awake carries on the awake, waking up the next
+         * processes of the queue: this holds even if a signal or the timeout came meanwhile,
+         * otherwise the processes behind it would never be woken up
+         */
+
+        if(waiter.cascade)
+                barrier_cascade(barrier_tag);
+
+        /*
+         * The process no longer uses the wait queue of the tag, so drop its reference to the barrier
+         */
+
+        barrier_put(barrier);
+
+        /*
+         * Return the outcome of the system call
+         */
+
+        pr_debug("System call sys_sleep_on_barrier returned this value:%d\n",ret);
+        return ret;
+}
+
+/*
+ * Put the current process to sleep on barrier with given IPC identifier on the queue
+ * corresponding to the given tag
+ *
+ * @bd: IPC identifier of the barrier that the process wants to use in order to synchronize
+ *      with other processes
+ * @tag: index of specific queue of the barrier onto which the process wants to sleep
+ *
+ * Returns an error code in case something went wrong, -EINTR in case the process has
+ * been woken up because it has received a signal, 0 otherwise
  */
 
-void barrier_unlock(struct barrier_struct* barrier){
-        struct kern_ipc_perm* barrier_ipc_perm=&(barrier->barrier_perm);
-        spin_unlock(&(barrier_ipc_perm->lock));
-        rcu_read_unlock();
+long sys_sleep_on_barrier(int bd,int tag){
+        return do_sleep_on_barrier(bd,tag,NULL,HRTIMER_MODE_REL);
 }
 
 /*
- * Dynamically create a "barrier_tag" element for the given tag
+ * Put the current process to sleep on barrier with given IPC identifier on the queue
+ * corresponding to the given tag, for at most the given time
  *
- * @tag: tag associated to the structure
+ * @bd: IPC identifier of the barrier that the process wants to use in order to synchronize
+ *      with other processes
+ * @tag: index of specific queue of the barrier onto which the process wants to sleep
+ * @timeout: the timeout, already copied from user space: it is relative to the current time,
+ *           unless BARRIER_TIMEOUT_ABS is given in "flags"
+ * @flags: BARRIER_TIMEOUT_ABS if the timeout is an absolute value of the CLOCK_MONOTONIC clock
  *
- * Returns the address of the barrier_tag structure or NULL
- * in case there's not enough memory for the new object
+ * Returns an error code in case something went wrong, -EINTR in case the process has
+ * been woken up because it has received a signal, -ETIMEDOUT in case the timeout elapsed
+ * before the tag was woken up, 0 otherwise
  */
 
-struct barrier_tag* newtag(int tag){
+long sys_sleep_on_barrier_timeout(int bd,int tag,const struct timespec* timeout,int flags){
 
         /*
-         * Pointer to the new barrier_tag instance
+         * Expiration time corresponding to the timeout
          */
 
-        struct barrier_tag* new_tag;
+        ktime_t expires;
 
         /*
-         * Request memory for the new object
+         * Check if the timeout and the flags are valid: if not, return -EINVAL
          */
 
-        new_tag=kmalloc(sizeof(struct barrier_tag),GFP_KERNEL);
+        if(flags & ~BARRIER_TIMEOUT_ABS)
+                return -EINVAL;
+        if(!timespec_valid(timeout))
+                return -EINVAL;
 
-        printk(KERN_INFO "BARRIER_MODULE->Address of the tag number %d:%lu\n",tag,new_tag);
+        expires=timespec_to_ktime(*timeout);
 
-        /*
-         * Check if the barrier_tag object has been successfully allocated: if not,
-         * return the error -ENOMEM (no memory space)
-         */
+        return do_sleep_on_barrier(bd,tag,&expires,(flags & BARRIER_TIMEOUT_ABS)?HRTIMER_MODE_ABS:HRTIMER_MODE_REL);
+}
 
-        if(!new_tag)
-                return ERR_PTR(-ENOMEM);
+/*
+ * Return the first tag among the ones selected by the given mask that has been woken up since
+ * a process went to sleep on it, i.e. whose generation is no longer the one recorded by the
+ * process; returns -1 if none of them has been woken up
+ *
+ * @barrier: barrier containing the tags
+ * @mask: bitmap of the tags the process is sleeping on
+ * @generations: generations of the tags recorded when the process went to sleep, one for each
+ *               tag of the mask in increasing order of tag
+ */
+
+int firedtag(struct barrier_struct* barrier,u64 mask,unsigned long* generations){
 
         /*
-         * Initialize the new "barrier_tag" object:
-         *
-         * 1- set the "counter" field to 0
-         * 2- set the tag field
-         * 3- initialize the list of pointers to wait queues of sleeping processes
-         * 4- set the boolean "sleeping" to true
+         * Tag to be checked and its position among the tags of the mask
          */
 
-        new_tag->counter=0;
-        new_tag->tag=tag;
-        INIT_LIST_HEAD(&(new_tag->queues));
-        new_tag->sleeping=false;
+        int tag,i=0;
 
-        /*
-         * Return the initialized barrier tag
-         */
+        for(tag=0;tag<BARRIER_TAGS;tag++)
+                if(mask & BARRIER_TAG_BIT(tag)){
+                        if(ACCESS_ONCE(barrier->tags[tag]->generation)!=generations[i])
+                                return tag;
+                        i++;
+                }
 
-        return new_tag;
+        return -1;
 }
 
 /*
- * Callback function invoked by the IPC subsystem when a new barrier has to be created
+ * Wake function of the processes sleeping on a set of tags: the awake of a tag passes the bit of
+ * the tag as key (see "awake_tag"), so only the processes whose set includes the tag are woken up,
+ * rather than all the processes sleeping on any set of tags of the barrier
  *
- * @ns: ipc_namespace to be considered; actually we don't care of this parameter, it is
- *      given just because the IPC subsystem requires uses it to handle its default
- *      synchronization objects (semaphores,shared memories and message queues)
- * @params: flags and key associated to the new barrier
+ * @wait: entry of the process in the wait queue of the barrier
+ * @mode: state of the processes to be woken up
+ * @sync: whether the wake up is synchronous
+ * @key: NULL, or the bit of the tag that has been woken up
  *
- * Returns the IPC identifier of the newly created barrier or some error code in case
- * something goes wrong.
+ * Returns 1 if the process has been woken up, 0 otherwise
+ */
+
+int barrier_mask_wake(wait_queue_t* wait,unsigned mode,int sync,void* key){
+
+        /*
+         * Sleeping process and bit of the tag that has been woken up
+         */
+
+        struct barrier_mask_waiter* waiter=container_of(wait,struct barrier_mask_waiter,wait);
+        u64* bit=key;
+
+        if(bit && !(waiter->mask & *bit))
+                return 0;
+
+        return autoremove_wake_function(wait,mode,sync,NULL);
+}
+
+/*
+ * Put the current process to sleep on barrier with given IPC identifier on all the tags selected
+ * by the given mask, until any of them is woken up: this way a single process can wait for
+ * several priority levels at once
  *
- * This function is called holding the mutex of the global (shared among all barriers)
- * "ipc_ids" structure as writer
+ * @bd: IPC identifier of the barrier that the process wants to use in order to synchronize
+ *      with other processes
+ * @mask: bitmap of the dense tags the process wants to sleep on, BARRIER_TAG_BIT(tag) for each of them
  *
+ * Returns an error code in case something went wrong, -EINTR in case the process has been
+ * woken up because it has received a signal, otherwise the tag whose awake woke up the process
+ * (the smallest one, if more tags have been woken up at the same time)
  */
 
-int newbarrier(struct ipc_namespace* ns, struct ipc_params* params){
+long sys_sleep_on_barrier_mask(int bd,u64 mask){
 
         /*
-         * The unique IPC identifier of the new barrier; recall that
-         * this id is unique within a "data structure type scope",i.e.
-         * there may be an IPC message queue or IPC semaphore with
-         * the same id as this barrier we are creating
+         * Return value of this system call and outcome of the registration on the tags
          */
 
-        int id;
+        int ret,err=0;
 
         /*
-         * The basic structure for the barrier we are creating
+         * Barrier associated to the given IPC identifier (if valid)
          */
 
-        struct barrier_struct *barrier;
+        struct barrier_struct* barrier;
 
         /*
-         * The key requested by the user-space process
+         * Tag to be checked, its position among the selected tags and tag that woke up the process
          */
 
-        key_t key = params->key;
+        int tag,i,fired=-1;
 
         /*
-         * The flags requested by the user-space process
+         * Tags the process has been registered on
          */
 
-        int barrierflags = params->flg;
+        u64 registered=0;
 
         /*
-         * Allocate the memory for the barrier: the barrier_structure is preceded by
-         * an RCU header which is necessary to protect our barrier during RCU read-side
-         * critical sections and then to update it after these critical sections are
-         * over in case some other process meanwhile (concurrently) updated them
+         * Generations of the selected tags when the process goes to sleep on them, one for each
+         * selected tag in increasing order of tag: they are kept on the stack for small sets of
+         * tags and allocated for the larger ones, so that the stack doesn't hold one for each of
+         * the BARRIER_TAGS tags
          */
 
-        barrier = ipc_rcu_alloc(sizeof(*barrier));
+        unsigned long stack_generations[BARRIER_MASK_STACK_TAGS];
+        unsigned long* generations=stack_generations;
+
+        /*
+         * Entry of the process in the wait queue of the barrier
+         */
 
-        printk(KERN_INFO "BARRIER_MODULE->Address of the barrier with key %d:%lu\n",key,barrier);
+        struct barrier_mask_waiter waiter;
 
         /*
-         * Return error in case there's not enough memory left
-         * for the barrier
+         * Structure of a selected tag
          */
 
-        if (!barrier) {
-                return -ENOMEM;
+        struct barrier_tag* barrier_tag;
+
+        pr_debug("System call sys_sleep_on_barrier_mask invoked with params: barrier descriptor=%d mask=%llx\n",bd,mask);
+
+        /*
+         * Check if at least one tag has been selected: if not, return -EINVAL
+         */
+
+        if(!mask){
+                ret=-EINVAL;
+                pr_debug("System call sys_sleep_on_barrier_mask returned this value:%d\n",ret);
+                return ret;
         }
 
         /*
-         * Set the key of the kern_ipc_perm  within the new barrier
+         * Allocate the generations of a large set of tags
          */
 
-        barrier->barrier_perm.key = key;
+        if(hweight64(mask)>BARRIER_MASK_STACK_TAGS){
+                generations=kmalloc(hweight64(mask)*sizeof(*generations),GFP_KERNEL);
+                if(!generations){
+                        ret=-ENOMEM;
+                        pr_debug("System call sys_sleep_on_barrier_mask returned this value:%d\n",ret);
+                        return ret;
+                }
+        }
 
         /*
-         * Set the mode (flag) of the kern_ipc_perm  within the new barrier:
-         * we make a bitwise AND with the flag "S_IRWXUGO", which grants
-         * read,write and execute permissions to user, group and others
+         * Look the barrier up without taking its lock (see "sys_sleep_on_barrier")
          */
 
-        barrier->barrier_perm.mode=barrierflags & S_IRWXUGO;
+        rcu_read_lock();
+        barrier=barrier_find_rcu(bd);
+        if(!barrier){
+                rcu_read_unlock();
+                if(generations!=stack_generations)
+                        kfree(generations);
+                ret=-EINVAL;
+                pr_debug("System call sys_sleep_on_barrier_mask returned this value:%d\n",ret);
+                return ret;
+        }
 
         /*
-         * Set to NULL the "security" field of the kern_ipc_perm structure,
-         * since this is only used in SELinux
+         * Get the "barrier_tag" structures of all the selected tags, allocating those that have never
+         * been used
          */
 
-        barrier->barrier_perm.security=NULL;
+        for(tag=0;tag<BARRIER_TAGS;tag++)
+                if(mask & BARRIER_TAG_BIT(tag)){
+                        barrier_tag=gettag(barrier,tag);
+                        if(IS_ERR(barrier_tag)){
+                                rcu_read_unlock();
+                                if(generations!=stack_generations)
+                                        kfree(generations);
+                                ret=PTR_ERR(barrier_tag);
+                                pr_debug("System call sys_sleep_on_barrier_mask returned this value:%d\n",ret);
+                                return ret;
+                        }
+                }
 
         /*
-         * Get a new id for the newly created barrier instance.
-         * The permission object (kern_ipc_perm) of the barrier is initialized
-         * and locked.
-         *
-         * The id returned is the one assigned by the IDR object within the ipc_ids
-         * structure but the actual IPC identifier is written into the permission
-         * object and is equal to
-         *
-         * IPC_id=SEQ_MULTIPLIER * seq + id;
-         *
-         * where "seq" is the sequence number of the barrier, "id" is the identifier
-         * returned by IDR and SEQ_MULTIPLIER is a constant equal to IPCMNI (32768)
-         *
-         * The third parameter determines the limit for the number of ids used for the
-         * barrier: in the IPC subsystem this parameter is taken from the ipc_namespace,
-         * we define a specific constant for it
+         * Take a reference to the barrier, so that it is not freed while the process is still
+         * using its wait queue, and count the process among the ones sleeping on a set of tags
+         * before taking the lock of any of them, so that no awake of its tags can miss it
          */
 
-        id = ipc_addid(barrier_ids,&barrier->barrier_perm,BARRIER_IDS_MAX);
+        if(!atomic_inc_not_zero(&barrier->refcount)){
+                rcu_read_unlock();
+                if(generations!=stack_generations)
+                        kfree(generations);
+                ret=-EINVAL;
+                pr_debug("System call sys_sleep_on_barrier_mask returned this value:%d\n",ret);
+                return ret;
+        }
+        atomic_inc(&barrier->mask_sleepers);
 
         /*
-         * If the id returned is negative, this is a sign that something went wrong,
-         * so the barrier object has to be removed, together with the rcu_head structure
-         * associated -> the function below decreases the counter of references to the
-         * RCU-protected barrier structure (the counter is stored within the rcu header
-         * prepended to the barrier structure) and then checks if this counter is null,
-         * i.e. if no other process has references to this data structure: if that's the
-         * case, the "call_rcu" function from the RCU API is invoked, so the structure will
-         * be removed as soon as all the RCU read-side critical sections connected to it
-         * will be over
+         * Register the process on each of the selected tags in turn, holding the lock of one tag at
+         * a time: increment its counter, set its bit in the bitmap of the barrier and record its
+         * generation. The arrival of the process may make a counting tag reach its threshold: it is
+         * woken up immediately, so the process doesn't actually go to sleep below
          *
-         * The error code is then returned.
+         * In case the barrier has been released or the limit of sleeping processes of a tag has
+         * been reached, the process gives up without going to sleep and withdraws from the tags
+         * it has already been registered on
+         */
+
+        for(tag=0,i=0;tag<BARRIER_TAGS && !err;tag++)
+                if(mask & BARRIER_TAG_BIT(tag)){
+                        barrier_tag=barrier->tags[tag];
+                        spin_lock(&barrier_tag->lock);
+                        if(barrier->barrier_perm.deleted)
+                                err=-EINVAL;
+                        else if(barrier_tag->counter>=barrier->per_tag_max){
+                                err=-ENOSPC;
+                                barrier_stat_inc(BARRIER_STAT_ENOSPC);
+                        }
+                        else{
+                                arrivetag(barrier,barrier_tag);
+                                generations[i++]=barrier_tag->generation;
+                                registered|=BARRIER_TAG_BIT(tag);
+                                checkthreshold(barrier,barrier_tag);
+                        }
+                        spin_unlock(&barrier_tag->lock);
+                }
+        rcu_read_unlock();
+
+        /*
+         * Put the current process to sleep on the wait queue of the processes sleeping on a set of
+         * tags, until any of its tags is woken up or a signal comes: same loop as
+         * "wait_event_interruptible", with an entry that is only woken up by the awakes of the
+         * tags of the process
          */
 
-        if(id<0){
-                ipc_rcu_putref(barrier);
-                return id;
+        if(!err){
+                barrier_stat_inc(BARRIER_STAT_SLEEPS);
+                init_wait(&waiter.wait);
+                waiter.wait.func=barrier_mask_wake;
+                waiter.mask=registered;
+                for(;;){
+                        prepare_to_wait(&barrier->mask_queue,&waiter.wait,TASK_INTERRUPTIBLE);
+                        if(firedtag(barrier,registered,generations)>=0 || signal_pending(current))
+                                break;
+                        schedule();
+                }
+                finish_wait(&barrier->mask_queue,&waiter.wait);
         }
 
         /*
-         * Initialize the head of the list of "barrier_tag" objects
+         * Holding the lock on a tag, its generation can't change: find the tag that woke up the
+         * process (if any) and decrease the counters of the tags the process is no longer sleeping
+         * on, i.e. those whose generation is still the one recorded by the process (the release of
+         * the barrier wakes up all the tags, so none is left in that case)
          */
 
-        INIT_LIST_HEAD(&(barrier->tags));
+        for(tag=0,i=0;tag<BARRIER_TAGS;tag++)
+                if(registered & BARRIER_TAG_BIT(tag)){
+                        barrier_tag=barrier->tags[tag];
+                        spin_lock(&barrier_tag->lock);
+                        if(barrier_tag->generation==generations[i++])
+                                leavetag(barrier,barrier_tag);
+                        else if(fired<0)
+                                fired=tag;
+                        spin_unlock(&barrier_tag->lock);
+                }
+        atomic_dec(&barrier->mask_sleepers);
 
         /*
-         * The new instance of barrier is complete, so we can unlock it to make
-         * it accessible to all the other processes
+         * Return the tag that woke up the process, even if a signal came at the same time or the
+         * registration failed after the tag had already been woken up, otherwise return -EINTR
+         * (see "sys_sleep_on_barrier") or the error of the registration
          */
 
-        barrier_unlock(barrier);
+        if(fired>=0)
+                ret=fired;
+        else if(err)
+                ret=err;
+        else{
+                ret=-EINTR;
+                barrier_stat_inc(BARRIER_STAT_EINTR);
+        }
 
         /*
-         * Return the assigned IPC identifier
+         * The process no longer uses the wait queue of the barrier, so drop its reference
          */
 
-        return barrier->barrier_perm.id;
+        barrier_put(barrier);
+        if(generations!=stack_generations)
+                kfree(generations);
+
+        pr_debug("System call sys_sleep_on_barrier_mask returned this value:%d\n",ret);
+        return ret;
 }
 
 /*
- * Return a pointer to the "barrier_tag" structure corresponding to the given tag within the given
- * barrier; returns NULL if this is not found
- *
- * @barrier: permission object of the barrrier where the tag has to be searched
- * @tag: tag to search for
- *
- * This has to be called only after the tag value has been verified to be valid, i.e. 0<=tag<=31, so here
- * we don't need further checks
+ * Wake up all the processes synchronized on a certain tag of the barrier corresponding to the
+ * given IPC identifier
  *
- * Also this has to be called holding the lock on barrier
+ * @bd: IPC identifier of the barrier that the process wants to use in order to synchronize
+ *      with other processes
+ * @tag: index of specific queue of the barrier onto which the process wants to sleep
  *
+ * Returns an error code in case something went wrong, 0 otherwise
  */
 
-struct barrier_tag* findtag(struct barrier_struct* barrier,int tag){
+long sys_awake_barrier(int bd,int tag){
+
+        /*
+         * Return value of this system call
+         */
+
+        int ret;
 
         /*
-         * Pointer to the barrier_tag structure corresponding to the given tag
+         * Barrier associated to the given IPC identifier (if valid)
          */
 
-        struct barrier_tag* out;
+        struct barrier_struct* barrier;
 
         /*
-         * Scan the whole list until the "barrier_struct" corresponding to
-         * the given tag is found
+         * Structure corresponding to the given tag within the barrier associated
+         * to the given IPC identifier (if exists)
          */
 
-        list_for_each_entry(out,&barrier->tags,tag_list)
-                if(out->tag==tag)
-                        return out;
+        struct barrier_tag* barrier_tag;
 
-        return NULL;
+        pr_debug("System call sys_awake_barrier invoked with params: barrier descriptor=%d tag=%d\n",bd,tag);
+
+        /*
+         * Check if the provided tag is valid (0<=tag<BARRIER_TAG_SPACE):
+         * if not, return -EINVAL
+         */
+
+        if(tag<0 || tag>=BARRIER_TAG_SPACE) {
+                ret=-EINVAL;
+                pr_debug("System call sys_awake_barrier returned this value:%d\n",ret);
+                return ret;
+        }
+
+        /*
+         * Fast path: in case the barrier doesn't exist or no process is sleeping on the tag, return
+         * without taking the lock on the barrier, so that processes polling a tag with awakes don't
+         * contend on it
+         */
+
+        ret=peektag(bd,tag);
+        if(ret<=0){
+                if(!ret){
+                        ret=-EINVAL;
+                        barrier_stat_inc(BARRIER_STAT_AWAKE_NOTAG);
+                }
+                pr_debug("System call sys_awake_barrier returned this value:%d\n",ret);
+                return ret;
+        }
+
+        /*
+         * Look the barrier up again and lock the structure of the tag, in case some process is
+         * still sleeping on it: the lock on the barrier is not taken, so awakes of different
+         * tags of the same barrier proceed in parallel
+         */
+
+        rcu_read_lock();
+        barrier=barrier_find_rcu(bd);
+        if(!barrier){
+                rcu_read_unlock();
+                ret=-EINVAL;
+                pr_debug("System call sys_awake_barrier returned this value:%d\n",ret);
+                return ret;
+        }
+
+        barrier_tag=findtag(barrier,tag);
+        if(!barrier_tag) {
+
+                /*
+                 * No process is sleeping on the requested tag anymore, so return -EINVAL
+                 */
+
+                rcu_read_unlock();
+                barrier_stat_inc(BARRIER_STAT_AWAKE_NOTAG);
+                pr_debug("System call sys_awake_barrier returned this value:%d\n",-EINVAL);
+                return -EINVAL;
+        }
+
+        /*
+         * Wake up all the processes sleeping on the given tag
+         */
+
+        awake_tag(barrier,barrier_tag);
+
+        /*
+         * Release the lock on the tag
+         */
+
+        spin_unlock(&barrier_tag->lock);
+        rcu_read_unlock();
+
+        /*
+         * The awakening was successful, so return 0
+         */
+
+        return 0;
 }
 
 /*
- * This function wakes up all the processes sleeping on the synchronization level corresponding
- * to the given barrier_tag structure and then removes the last one from the associated list
- * of the barrier object
+ * Wake up at most the given number of processes synchronized on a certain tag of the barrier
+ * corresponding to the given IPC identifier, in the order they went to sleep: the others keep
+ * sleeping, so that a work-distribution pattern doesn't wake up a herd of processes that
+ * immediately go back to sleep
  *
- * Function has to be invoked holding the lock on the barrier object containing the tags
+ * @bd: IPC identifier of the barrier
+ * @tag: the tag
+ * @n: maximum number of processes to be woken up
  *
- * @barrier_tag: structure representing the tag to be woken up
- *
- * Returns nothing
+ * Returns an error code in case something went wrong, otherwise the number of processes that
+ * have been woken up (0 in case no process is sleeping on the tag)
  */
 
-void awake_tag(struct barrier_tag* barrier_tag){
+long sys_awake_barrier_n(int bd,int tag,int n){
+
+        /*
+         * Return value of this system call
+         */
 
-        printk(KERN_INFO "BARRIER_MODULE->Waking up tag:%d\n",barrier_tag->tag);
+        int ret;
 
         /*
-         * Pointer to an element of the list associated to the barrier_tag
+         * Barrier and tag associated to the given IPC identifier (if valid)
          */
 
-        struct process_queue* tag_list_element;
+        struct barrier_struct* barrier;
+        struct barrier_tag* barrier_tag;
+
+        pr_debug("System call sys_awake_barrier_n invoked with params: barrier descriptor=%d tag=%d n=%d\n",bd,tag,n);
+
+        if(tag<0 || tag>=BARRIER_TAG_SPACE || n<=0){
+                ret=-EINVAL;
+                pr_debug("System call sys_awake_barrier_n returned this value:%d\n",ret);
+                return ret;
+        }
 
         /*
-         * Head of wait queue in process
+         * Same fast path as "sys_awake_barrier": nothing to do in case no process is sleeping
+         * on the tag
          */
 
-        wait_queue_head_t* head;
+        ret=peektag(bd,tag);
+        if(ret<=0){
+                if(!ret)
+                        barrier_stat_inc(BARRIER_STAT_AWAKE_NOTAG);
+                pr_debug("System call sys_awake_barrier_n returned this value:%d\n",ret);
+                return ret;
+        }
+
+        rcu_read_lock();
+        barrier=barrier_find_rcu(bd);
+        if(!barrier)
+                ret=-EINVAL;
+        else if((barrier_tag=findtag(barrier,tag))){
+                ret=awake_tag_n(barrier,barrier_tag,n);
+                spin_unlock(&barrier_tag->lock);
+        }
+        else{
+                ret=0;
+                barrier_stat_inc(BARRIER_STAT_AWAKE_NOTAG);
+        }
+        rcu_read_unlock();
+
+        pr_debug("System call sys_awake_barrier_n returned this value:%d\n",ret);
+        return ret;
+}
+
+/*
+ * Wake up all the processes synchronized on a set of tags of the barrier corresponding to the
+ * given IPC identifier: the tags are woken up in turn, each one holding only its own lock
+ *
+ * @bd: IPC identifier of the barrier that the process wants to use in order to synchronize
+ *      with other processes
+ * @mask: bitmap of the dense tags to be woken up, i.e. BARRIER_TAG_BIT(tag) for each of them;
+ *        BARRIER_TAGS_FROM(tag) selects all the tags greater than or equal to "tag"
+ *
+ * Returns an error code in case something went wrong, otherwise the number of tags that have
+ * been woken up (tags without sleeping processes are skipped)
+ */
+
+long sys_awake_barrier_mask(int bd,u64 mask){
 
         /*
-         * It is necessary to set the value of the field "sleeping" (from the barrier_tag structure)
-         * to "true" and then  call the "wake_up" function on each of the wait queues stored in the list "queues".
-         *
-         * In this way, as soon as the sleeping processes wake up, they realize that the sleeping
-         * condition no longer holds, so they go back to the TASK_RUNNING state and are removed from
-         * the wait queue
+         * Return value of this system call
          */
 
-        barrier_tag->sleeping=true;
+        int ret;
 
         /*
-         * Scan the list of wait queues head and wake the single process sleeping on each of them
-         * The "wake_up" function iterates through all the elements of the wait queue until they
-         * have all woken up. In particular it invokes the "autoremove_wake_function" on each sleeping
-         * process: this function returns 1 when the process has woken up, 0 otherwise, so it keeps
-         * trying to wake up processes until on all of them the "wake up" function has returned 1
+         * Barrier associated to the given IPC identifier (if valid)
          */
 
-        list_for_each_entry(tag_list_element,&barrier_tag->queues,queue_list) {
-                wake_up(tag_list_element->queue);
-        }
+        struct barrier_struct* barrier;
 
-        printk(KERN_INFO "BARRIER_MODULE->Woken up tag:%d\n",barrier_tag->tag);
+        pr_debug("System call sys_awake_barrier_mask invoked with params: barrier descriptor=%d mask=%llx\n",bd,mask);
 
         /*
-         * Remove the structure associated to this tag from the corresponding list of the barrier
+         * Check if at least one tag has been selected: if not, return -EINVAL
          */
 
-        list_del(&barrier_tag->tag_list);
+        if(!mask){
+                ret=-EINVAL;
+                pr_debug("System call sys_awake_barrier_mask returned this value:%d\n",ret);
+                return ret;
+        }
+
+        /*
+         * Look the barrier up without taking its lock: in case the barrier doesn't exist or none
+         * of the selected tags has sleeping processes, return without taking any lock (see
+         * "peektag"), otherwise wake up the selected tags taking the lock of each one in turn
+         */
 
-        printk(KERN_INFO "BARRIER_MODULE->Removed tag structure from list of tags:%d\n",barrier_tag->tag);
+        rcu_read_lock();
+        barrier=barrier_find_rcu(bd);
+        if(!barrier)
+                ret=-EINVAL;
+        else if(activetags(barrier) & mask)
+                ret=awake_mask(barrier,mask);
+        else
+                ret=0;
+        rcu_read_unlock();
 
-        /*
-         * Once we exit the above loop, we can be sure that all the processes synchronized on the current
-         * tag have been woken up => now we can remove the structure corresponding to the tag
-         */
+        if(!ret)
+                barrier_stat_inc(BARRIER_STAT_AWAKE_NOTAG);
 
-        kfree(barrier_tag);
+        pr_debug("System call sys_awake_barrier_mask returned this value:%d\n",ret);
+        return ret;
 }
 
 /*
- * Remove the barrier object associated to the given permission object:
+ * Set the number of sleeping processes that automatically wakes up a tag of the barrier
+ * corresponding to the given IPC identifier (counting barrier): the process whose arrival
+ * makes the number of processes sleeping on the tag reach the threshold wakes up all of
+ * them in kernel, so no other process has to invoke "awake_barrier". In case the threshold
+ * is already reached by the processes currently sleeping on the tag, they are woken up
+ * immediately
  *
- * 1-awake all processes sleeping on the barrier
- * 2-remove all the wait queues in the kernel mode stack of the processes that were
- *   sleeping on the barrier
- * 3-remove the corresponding entry from the IDR object of barrier_ids
- *
- * @perm: permission object of the barrier to be removed
+ * @bd: IPC identifier of the barrier
+ * @tag: tag whose threshold has to be set
+ * @threshold: number of processes, from 1 to the limit of the barrier; 0 disables the automatic
+ *             awake of the tag
  *
- * This function is called holding the mutex of the ipc_ids structure for barriers and
- * the lock of the permission object of the barrier to be released
+ * Returns an error code in case something went wrong, 0 otherwise
  */
 
-void freebarrier(struct kern_ipc_perm* perm){
-
-        /*
-         * Pointer to barrier to be removed
-         */
-
-        struct barrier_struct* to_be_removed;
+long sys_set_barrier_threshold(int bd,int tag,int threshold){
 
         /*
-         * Structure representing the single tag whose processes has to be woken up
+         * Return value of this system call
          */
 
-        struct barrier_tag* tag;
+        int ret;
 
         /*
-         * Temporary pointer used inside "list_for_each_entry_safe"
+         * Barrier associated to the given IPC identifier (if valid)
          */
 
-        struct barrier_tag* temp;
+        struct barrier_struct* barrier;
 
         /*
-         * Get the barrier corresponding to the given permission object
+         * Structure representing the given tag
          */
 
-        to_be_removed=container_of(perm,struct barrier_struct,barrier_perm);
+        struct barrier_tag* barrier_tag;
 
-        printk(KERN_INFO "BARRIER_MODULE->Releasing barrier with id %d at address %lu\n",perm->id,to_be_removed);
+        pr_debug("System call sys_set_barrier_threshold invoked with params: barrier descriptor=%d tag=%d threshold=%d\n",bd,tag,threshold);
 
         /*
-         * Wake up processes sleeping on each tag and release objects associated to the
-         * tags themselves
-         *
-         * Inside the loop we are going to delete barrier_tag structures (after processes sleeping on them
-         * have been woken up) so we need the "safe" version of "list_for_each_entry", which makes use of
-         * a further pointer (second parameter) to save the address of the entry that is gonna be deleted
+         * Check if the provided tag and threshold are valid: if not, return -EINVAL
          */
 
-        list_for_each_entry_safe(tag,temp,&to_be_removed->tags,tag_list)
-                awake_tag(tag);
+        if(tag<0 || tag>=BARRIER_TAG_SPACE || threshold<0){
+                ret=-EINVAL;
+                pr_debug("System call sys_set_barrier_threshold returned this value:%d\n",ret);
+                return ret;
+        }
 
         /*
-         * Stop the association between the IPC identifier (provided by the idr of the
-         * ipc_ids data structure) and the permission object of the barrier: now it's
-         * no longer reachable using the IPC identifier
+         * Look the barrier up without taking its lock (see "sys_sleep_on_barrier")
          */
 
-        printk(KERN_INFO "BARRIER_MODULE->Before removing id %d from idr\n",perm->id);
-
-        ipc_rmid(barrier_ids,perm);
-
-        printk(KERN_INFO "BARRIER_MODULE->Removed id %d from idr\n",perm->id);
+        rcu_read_lock();
+        barrier=barrier_find_rcu(bd);
+        if(!barrier){
+                rcu_read_unlock();
+                ret=-EINVAL;
+                pr_debug("System call sys_set_barrier_threshold returned this value:%d\n",ret);
+                return ret;
+        }
 
         /*
-         * Check if removed: we expect we can't find the entry in the idr
+         * The threshold can't be reached if it exceeds the limit of sleeping processes of the barrier
          */
 
-        void* prova=tag;
-
-        prova=idr_find(&barrier_ids->ipcs_idr,(perm->id) % IPCMNI);
-
-        if(!prova)
-                printk(KERN_INFO "BARRIER_MODULE->Released id of barrier with id %d\n",perm->id);
-        else
-                printk(KERN_INFO "BARRIER_MODULE->Couldn't find id %d\n",perm->id);
+        if(threshold>barrier->per_tag_max){
+                rcu_read_unlock();
+                ret=-EINVAL;
+                pr_debug("System call sys_set_barrier_threshold returned this value:%d\n",ret);
+                return ret;
+        }
 
         /*
-         * Release the lock on the permission object
+         * Get the "barrier_tag" structure of the given tag, which keeps the threshold even while
+         * no process is sleeping on the tag
          */
 
-        barrier_unlock(to_be_removed);
-
-        printk(KERN_INFO "BARRIER_MODULE->Unlocked barrier with id %d\n",perm->id);
+        barrier_tag=gettag(barrier,tag);
+        if(IS_ERR(barrier_tag)){
+                rcu_read_unlock();
+                ret=PTR_ERR(barrier_tag);
+                pr_debug("System call sys_set_barrier_threshold returned this value:%d\n",ret);
+                return ret;
+        }
 
         /*
-         * Free memory assigned to the barrier
+         * Set the threshold and wake up the tag in case enough processes are already sleeping on it
          */
 
-        ipc_rcu_putref(to_be_removed);
+        spin_lock(&barrier_tag->lock);
+        barrier_tag->threshold=threshold;
+        if(barrier_tag->counter)
+                checkthreshold(barrier,barrier_tag);
+        spin_unlock(&barrier_tag->lock);
+        rcu_read_unlock();
 
-        printk(KERN_INFO "BARRIER_MODULE->Removed barrier with id %d\n",perm->id);
+        ret=0;
+        pr_debug("System call sys_set_barrier_threshold returned this value:%d\n",ret);
+        return ret;
 }
 
 /*
- * Callback function invoked on each pointer registered in the idr object when
- * it is necessary to iterate through them
+ * Instantiate a new barrier synchronization object
  *
- * @id: id associated to the pointer
- * @p: the pointer itself
- * @data: further data for the function
+ * @ key: this value is given in order to ask for a certain barrier; if the
+ * "IPC_PRIVATE" key is specified, a new barrier is created
+ * @flags: flags that determine how the barrier should be created or returned,
+ * if it exists. They are:
+ *
+ * 1)"IPC_CREAT": in case no barrier corresponding to the provided key exists, a new barrier is created
+ * 2)"IPC_EXCL" | "IPC_CREAT": in case no barrier corresponding to the provided key exists, a new barrier
+ * is created, otherwise error "-EEXIST" is returned
+ *
+ * Returns:
+ *
+ * 1)-ENOMEM, in case the limit for the number of barriers that can be allocated has been reached
+ * or if there's not enough memory to allocate a new barrier
+ * 2)-ENOSPC, in case the number of barriers in use at the same time has been reached or if no more
+ * IDs can be allocated by the IDR subsystem
+ * 3)The unique IPC identifier (id) of the instance of barrier corresponding to the key provided or
+ * the id of a new instance in case the key is IPC_PRIVATE or the key is not found and the flag "IPC_CREAT"
+ * but not flag "IPC_EXCL" are specified
+ * 4)-ENOENT, in case the key is not found and the flag "IPC_CREAT" is not specified
+ * 5)-EINVAL, in case flags other than "IPC_CREAT", "IPC_EXCL", "BARRIER_ADAPTIVE", "BARRIER_PREALLOC"
+ * and the permission bits are specified, as for the local barriers (see "barrier_get_local"), so that
+ * they stay available for future flags
  *
- * Returns 0 in case of success, -1 otherwise
+ * Existing barriers are looked up by key without taking any lock, while the mutex of the registry
+ * of the namespace is only taken to create a new barrier
+ *
+ * Common implementation of "get_barrier" and "get_barrier_limit": @per_tag_max is the maximum number
+ * of processes sleeping on each tag of the barrier in case a new one is created
  */
 
-int idr_iterate_callback (int id, void *p, void *data){
+long do_get_barrier(key_t key,int flags,int per_tag_max){
 
         /*
-         * Pointer to the current permission object registered in the idr
+         * Return value of this system call
          */
 
-        struct kern_ipc_perm* perm;
+        int ret;
 
         /*
-         * Cast the pointer received as second parameter
+         * Registry of the barriers of the namespace of the current process and barrier having
+         * the requested key
          */
 
-        perm=(struct kern_ipc_perm*)p;
-
-        printk(KERN_INFO "BARRIER_MODULE->Barrier id :%d\n",perm->id);
+        struct barrier_ns* registry;
+        struct barrier_struct* barrier;
 
         /*
-         * Acquire the lock on the permission object pointed by p
+         * Parameters of the new barrier, in case one is created
          */
 
-        rcu_read_lock();
-        spin_lock(&perm->lock);
+        struct ipc_namespace *ns;
+        struct ipc_params params;
 
         /*
-         * Release the barrier associated to the permission object
+         * Use ipc_namespace of the current process
          */
 
-        freebarrier(perm);
+        ns = current->nsproxy->ipc_ns;
 
         /*
-         * It has to be successful, so return 0
+         * The parameters to request for a new barrier
          */
 
-        return 0;
-}
+        params.key = key;
+        params.flg = flags;
 
-/*
- * Remove the ipc_ids structure associated to the barriers
- *
- * First it is necessary to acquire the mutex of the ipc_ids as writer and then remove
- * all the instance of barriers, each corresponding to an IPC identifier stored in the
- * idr object.
- *
- * As soon as there are no more instances of barrier in the system, it is possible to
- * remove the ipc_ids structure and free memory
- *
- * @barrier_ids: the ipc_ids structure of the barriers
- */
+        pr_debug("System call sys_get_barrier invoked with params: key=%d flags=%d per_tag_max=%d\n", key, flags, per_tag_max);
 
-void remove_ids(void){
+        if(flags & ~(IPC_CREAT | IPC_EXCL | BARRIER_ADAPTIVE | BARRIER_PREALLOC | 0777)){
+                pr_debug("System call sys_get_barrier returned this value:%d\n", -EINVAL);
+                return -EINVAL;
+        }
+
+        /*
+         * Look the key up in the hash table of the registry without taking any lock: getting
+         * a barrier that already exists, which is what most processes do, never waits for the
+         * creation or the release of other barriers. A barrier released right after being
+         * found is the same as a barrier released right after "get_barrier" returned
+         */
+
+        if(key!=IPC_PRIVATE){
+                rcu_read_lock();
+                registry=barrier_ns_find(ns);
+                barrier=registry ? barrier_find_key(registry,key) : NULL;
+                if(barrier){
+                        ret=(flags & IPC_CREAT) && (flags & IPC_EXCL) ? -EEXIST : barrier->barrier_perm.id;
+                        rcu_read_unlock();
+                        pr_debug("System call sys_get_barrier returned this value:%d\n", ret);
+                        return ret;
+                }
+                rcu_read_unlock();
+                if(!(flags & IPC_CREAT)){
+                        pr_debug("System call sys_get_barrier returned this value:%d\n", -ENOENT);
+                        return -ENOENT;
+                }
+        }
 
         /*
-         * Acquire the mutex on the ipc_ids structure of the barriers because we are going
-         * to remove all the entries from its IDR object
+         * A new barrier has to be created: get the registry of the namespace, which is created
+         * in case this is the first barrier of the namespace
          */
 
-        down_write(&barrier_ids->rw_mutex);
+        registry=barrier_ns_get(ns,1);
+        if(IS_ERR(registry)){
+                ret=PTR_ERR(registry);
+                pr_debug("System call sys_get_barrier returned this value:%d\n", ret);
+                return ret;
+        }
+
+        do{
+
+                /*
+                 * Preallocate the nodes of the IDR, since they can't be allocated holding the
+                 * lock on the new barrier, and then acquire the mutex of the registry as writer
+                 */
+
+                if(!idr_pre_get(&registry->ids.ipcs_idr,GFP_KERNEL)){
+                        ret=-ENOMEM;
+                        break;
+                }
+                down_write(&registry->ids.rw_mutex);
+
+                /*
+                 * Another process may have created a barrier with the same key meanwhile: in that
+                 * case it is returned, as it would have been by the lookup above
+                 */
+
+                barrier=NULL;
+                if(key!=IPC_PRIVATE){
+                        rcu_read_lock();
+                        barrier=barrier_find_key(registry,key);
+                        rcu_read_unlock();
+                }
+                if(barrier)
+                        ret=(flags & IPC_EXCL) ? -EEXIST : barrier->barrier_perm.id;
+                else{
+                        ret=newbarrier(registry,&params,per_tag_max);
+
+                        /*
+                         * If a new barrier is successfully instantiated, increase the usage counter of the current
+                         * module: this prevent the module from being removed while some processes are using it (i.e.
+                         * there is at least one instance of barrier). The counter will be decreased when the barrier
+                         * is released. The registries of the namespaces other than the initial one are visited from
+                         * time to time as long as they exist, in case the namespace is left with barriers when its
+                         * processes exit (see "barrier_ns_reap")
+                         */
+
+                        if(ret>=0){
+                                pr_debug("Incrementing usage counter:%d and %d\n",ret,key);
+                                try_module_get(THIS_MODULE);
+                                if(barrier_ns_reapable(ns))
+                                        schedule_delayed_work(&barrier_ns_reap_work,BARRIER_NS_REAP_SECONDS*HZ);
+                        }
+                }
+                up_write(&registry->ids.rw_mutex);
+
+                /*
+                 * The preallocated nodes of the IDR may have been used up by another process in the
+                 * meantime: in that case, try again
+                 */
+
+        }while(ret==-EAGAIN);
 
         /*
-         * Iterate through all permission objects, one for each barrier, registered with the
-         * idr of the ipc_ids structure: for each of them, release the corresponding barrier
-         *
-         * The function below, from the IDR API, iterates through all the registered pointers
-         * and applies to them the callback function given as second parameter; the third
-         * parameter represents further data that can be passed to the callback function, but
-         * we don't need it
-         *
-         * SHOULD NOT EXECUTE NO ITERATION: actually we wait for barriers to be release before
-         * allowing the removal of the module, so when we get here all barrier instances should
-         * have already been released.
+         * A new barrier holds its own reference to the registry
          */
 
-        idr_for_each(&barrier_ids->ipcs_idr,idr_iterate_callback,NULL);
+        barrier_ns_put(registry);
 
-        printk(KERN_INFO "BARRIER_MODULE->All barriers removed\n");
+        pr_debug("System call sys_get_barrier returned this value:%d\n", ret);
 
         /*
-         * Once the above function has finished its task, there are no more instances of barrier
-         * around, so we can unlock the ipc_ids and then free it
+         * Return the result of the system call
          */
 
-        up_write(&barrier_ids->rw_mutex);
-        kfree(barrier_ids);
+        return ret;
+}
+
+long sys_get_barrier(key_t key,int flags){
+        return do_get_barrier(key,flags,barrier_per_tag_max);
 }
 
 /*
- * SYSTEM CALL KERNEL SERVICE ROUTINES - start
+ * Get a barrier like "get_barrier", choosing the maximum number of processes that can sleep on each
+ * tag of the barrier in case a new one is created; the limit of an existing barrier is not changed
  *
- * 1 - sys_get_barrier
- * 2 - sys_release_barrier
- * 3 - sys_sleep_on_barrier
- * 4 - sys_awake_barrier
+ * @key: key of the barrier
+ * @flags: same as "get_barrier"
+ * @per_tag_max: maximum number of processes sleeping on a tag, from 1 to the module parameter
+ *               "barrier_per_tag_max"; 0 stands for the module parameter itself
+ *
+ * Returns the same values as "get_barrier", or -EINVAL in case the limit is not valid
  */
 
+long sys_get_barrier_limit(key_t key,int flags,int per_tag_max){
+        if(per_tag_max<0 || per_tag_max>barrier_per_tag_max){
+                pr_debug("System call sys_get_barrier_limit returned this value:%d\n",-EINVAL);
+                return -EINVAL;
+        }
+        if(!per_tag_max)
+                per_tag_max=barrier_per_tag_max;
+        return do_get_barrier(key,flags,per_tag_max);
+}
+
 /*
- * Put the current process to sleep on barrier with given IPC identifier on the queue
- * corresponding to the given tag
+ * Release a barrier synchronization instance given its IPC identifier
  *
- * @bd: IPC identifier of the barrier that the process wants to use in order to synchronize
- *      with other processes
- * @tag: index of specific queue of the barrier onto which the process wants to sleep
+ * @bd: IPC identifier of the barrier to be removed
  *
- * Returns an error code in case something went wrong, -ERESTARTSYS in case the process has
- * been woken up because it has received a signal, 0 otherwise
+ * Returns a code indicating whether the operation was successful or not
  */
 
-asmlinkage long sys_sleep_on_barrier(int bd,int tag){
+long sys_release_barrier(int bd){
 
         /*
          * Return value of this system call
@@ -579,53 +2970,60 @@ asmlinkage long sys_sleep_on_barrier(int bd,int tag){
         int ret;
 
         /*
-         * Permission object associated to the given IPC identifier (if valid)
+         * User id of the current owner of the barrier to be removed
          */
 
-        struct kern_ipc_perm* barrier_perm;
+        uid_t euid;
 
         /*
-         * Barrier associated to the given IPC identifier (if valid)
+         * The permission object of the barrier to be removed
          */
 
-        struct barrier_struct* barrier;
+        struct kern_ipc_perm* barrier_perm;
 
         /*
-         * Structure corresponding to the given tag within the barrier associated
-         * to the given IPC identifier (if exists)
+         * Registry of the barriers of the namespace of the current process
          */
 
-        struct barrier_tag* barrier_tag;
+        struct barrier_ns* registry;
+
+        pr_debug("System call sys_release_barrier invoked with params: barrier descriptor=%d\n",bd);
 
         /*
-         * Structure representing the current process in the "queues" list (within
-         * the "barrier_tag" structure)
+         * Local barriers are only released by closing their file descriptor
          */
 
-        struct process_queue process_queue;
-
-        printk(KERN_INFO "System call sys_sleep_on_barrier invoked with params: barrier descriptor=%d tag=%d\n",bd,tag);
+        if(bd<0){
+                ret=-EINVAL;
+                pr_debug("System call sys_release_barrier returned this value:%d\n",ret);
+                return ret;
+        }
 
         /*
-         * Check if the provided tag is valid (less than 0<=tag<=31):
-         * if not, return -EINVAL
+         * Get the registry of the namespace: in case the namespace has none, it has no barrier
+         * to be released either
          */
 
-        if(tag<0 || tag >31) {
-                printk(KERN_INFO "System call sys_sleep_on_barrier returned this value:%d\n",ret);
-                ret=-EINVAL;
+        registry=barrier_ns_get(current->nsproxy->ipc_ns,0);
+        if(IS_ERR(registry)){
+                ret=PTR_ERR(registry);
+                pr_debug("System call sys_release_barrier returned this value:%d\n",ret);
                 return ret;
         }
 
         /*
-         * Check if a permission object associated to the provided IPC identifier exists and, if so,
+         * Acquire the mutex on the ipc_ids structure of the registry because we are going
+         * to remove an entry from its IDR object
+         */
+
+        down_write(&registry->ids.rw_mutex);
+
+        /*
+         * Check if a permission object corresponding to the provided IPC identifier exists and, if so,
          * return it in a locked state, otherwise return error code -EINVAL.
-         *
-         * TO BE CHECKED: SHOULDN'T WE ACQUIRE THE READ SEMAPHORE OF IPC IDS? WHAT IF AN ID IS REMOVED
-         * WHILE GETTING THE ID?
          */
 
-        barrier_perm=ipc_lock_check(barrier_ids, bd);
+        barrier_perm=ipc_lock_check(&registry->ids, bd);
 
         /*
          * In case an error code is returned, i.e. no barrier corresponding to the provided id is found,
@@ -633,605 +3031,901 @@ asmlinkage long sys_sleep_on_barrier(int bd,int tag){
          */
 
         if(IS_ERR(barrier_perm)){
+                up_write(&registry->ids.rw_mutex);
+                barrier_ns_put(registry);
                 ret=PTR_ERR(barrier_perm);
-                printk(KERN_INFO "System call sys_sleep_on_barrier returned this value:%d\n",ret);
+                pr_debug("System call sys_release_barrier returned this value:%d\n",ret);
                 return ret;
         }
 
+        pr_debug("BARRIER_MODULE->Number of barriers before invoking \"freebarrier\":%d\n",registry->ids.in_use);
+        freebarrier(barrier_perm);
+        pr_debug("BARRIER_MODULE->Number of barriers after invoking \"freebarrier\":%d\n",registry->ids.in_use);
+
         /*
-         * Get the instance of a barrier from its permission object using the "container_of" macro:
-         * given a pointer to a member of a structure and the type of the structure itself, it is
-         * possible to get the address of the specific instance of the structure to which given member
-         * is part of
+         * Release the mutex of the ipc_ids structure and then the reference to the registry:
+         * in case this was the last barrier of the namespace, the registry is freed
          */
 
-        barrier=container_of(barrier_perm,struct barrier_struct,barrier_perm);
+        up_write(&registry->ids.rw_mutex );
+        barrier_ns_put(registry);
 
         /*
-         * Check if a "barrier_tag" for the given tag exists in this barrier; if not, we have to allocate
-         * one
+         * The function was successful, so return 0
          */
 
-        barrier_tag=findtag(barrier,tag);
-        if(!barrier_tag){
+        ret=0;
 
-                printk(KERN_INFO "BARRIER_MODULE->Creating struct barrier_tag for tag:%d\n",tag);
 
-                /*
-                 * Allocate a new barrier_tag to handle the synchronization tag
-                 */
+        pr_debug("System call sys_release_barrier returned this value:%d\n",ret);
+
+        /*
+         * One more thing to do: decrease the usage counter of the module, otherwise it won't
+         * be ever possible to remove it
+         */
 
-                barrier_tag=newtag(tag);
+        module_put(THIS_MODULE);
 
-                /*
-                 * If the allocation was not successful, return the error -ENOMEM and
-                 * release the lock on the permission object
-                 */
+        /*
+         * Return 0
+         */
 
-                if(IS_ERR(barrier_tag)){
-                        barrier_unlock(barrier);
-                        ret=PTR_ERR(barrier_tag);
-                        printk(KERN_INFO "System call sys_sleep_on_barrier returned this value:%d\n",ret);
-                        return ret;
+        return ret;
+}
 
-                }
+/*
+ * SYSTEM CALL KERNEL SERVICE ROUTINES - end
+ */
 
-                printk(KERN_INFO "BARRIER_MODULE->Adding tag %d to list\n",tag);
+/*
+ * INSERT/REMOVE MODULE - start
+ */
 
-                /*
-                 * Add the newly created barrier_tag to the list of tags from the
-                 * barrier
-                 */
+/*
+ * BARRIER DEVICE - start
+ *
+ * The misc device "/dev/barrier" gives user space processes access to the barriers: every
+ * operation is an ioctl command on the device (see "barrier_ioctl.h"). The device also lets
+ * processes map the page shared with each barrier (see "barrier_shared"): the offset of the
+ * mapping selects the barrier, i.e. the page of the barrier with IPC identifier bd is at
+ * offset bd*PAGE_SIZE. The file descriptors of the local barriers created through the device
+ * are files of their own, whose page is at offset 0
+ */
 
-                list_add(&barrier_tag->tag_list,&barrier->tags);
+/*
+ * Map the page shared with a local barrier: the mapping is the page at offset 0 of the file
+ * descriptor of the barrier, which keeps the barrier alive while the page is inserted
+ *
+ * @file: file of the local barrier
+ * @vma: memory area to map the page into, exactly one page long and not writable
+ *
+ * Returns an error code in case something went wrong, 0 otherwise
+ */
 
-                printk(KERN_INFO "BARRIER_MODULE->Added tag %d to list\n",tag);
-        }
+int barrier_local_mmap(struct file* file,struct vm_area_struct* vma){
+        struct barrier_struct* barrier=file->private_data;
 
-        /*
-         * Check if the limit of sleeping processes for the given tag has been reached:if so, return
-         * -ENOSPC (no space left) error code and unlock the permission object
-         */
+        if(vma->vm_end-vma->vm_start!=PAGE_SIZE || vma->vm_pgoff)
+                return -EINVAL;
+        if(vma->vm_flags & VM_WRITE)
+                return -EPERM;
+        vma->vm_flags&=~VM_MAYWRITE;
 
-        if(barrier_tag->counter==BARRIER_PER_TAG_MAX){
-                barrier_unlock(barrier);
-                ret=-ENOSPC;
-                printk(KERN_INFO "System call sys_sleep_on_barrier returned this value:%d\n",ret);
-                return ret;
-        }
+        return vm_insert_page(vma,vma->vm_start,virt_to_page(barrier->shared));
+}
 
-        /*
-         * Declare and initialize the head of the wait queue onto which the process is
-         * going to sleep: since this is a local variable, it's gonna be allocated into
-         * the Kernel Mode Stack of the calling process.
-         */
+/*
+ * Release a local barrier once the last copy of its file descriptor has been closed, e.g. when
+ * the process that created it exits: the barrier is marked as released, so that no process
+ * goes to sleep on it anymore, and the processes still sleeping on it (which got there through
+ * a copy of the file descriptor closed meanwhile) are woken up. The memory is freed as soon
+ * as they have left
+ *
+ * @inode: inode of the file
+ * @file: file of the local barrier
+ *
+ * Returns 0
+ */
+
+int barrier_local_release(struct inode* inode,struct file* file){
+        struct barrier_struct* barrier=file->private_data;
+
+        barrier_lock(barrier);
+        barrier->barrier_perm.deleted=1;
+        barrier_unlock(barrier);
 
-        DECLARE_WAIT_QUEUE_HEAD(queue_head);
+        awake_all(barrier);
+        barrier_put(barrier);
+
+        pr_debug("BARRIER_MODULE->Released local barrier at address %p\n",barrier);
+
+        return 0;
+}
+
+/*
+ * Operations of the file descriptors of the local barriers
+ */
+
+struct file_operations barrier_local_fops={
+        .owner=THIS_MODULE,
+        .mmap=barrier_local_mmap,
+        .release=barrier_local_release,
+};
+
+/*
+ * Create a barrier private to the calling process, to synchronize its threads: the barrier
+ * is not registered in the IDR of any namespace, so it doesn't count towards the limit of
+ * the barriers of the namespace and no process can find it by key or IPC identifier. It is
+ * a new file descriptor instead, whose file holds the only long-lived reference to the
+ * barrier, so the barrier is released as soon as the last copy of the file descriptor is
+ * closed. The other operations take BARRIER_LOCAL_BD(fd) as the identifier of the barrier,
+ * which is resolved to the file through the table of the file descriptors of the calling
+ * process, without looking the IDR up (see "barrier_find_rcu")
+ *
+ * The file descriptor is only closed on exec: like any other file descriptor, it is inherited
+ * by the children created with fork() and it can be passed over a Unix socket, so the processes
+ * holding a copy share the barrier, which is then released once all of them have closed it
+ *
+ * @flags: flags of the barrier, BARRIER_ADAPTIVE and BARRIER_PREALLOC
+ * @per_tag_max: maximum number of processes sleeping on a tag, from 1 to the module parameter
+ *               "barrier_per_tag_max"; 0 stands for the module parameter itself
+ *
+ * Returns the new file descriptor, -EINVAL in case the flags or the limit are not valid,
+ * -ENOMEM in case there's not enough memory left or the error of the creation of the file
+ */
+
+long barrier_get_local(int flags,int per_tag_max){
 
         /*
-         * Set the instance representing the current process in the "queues" list of the barrier_tag
-         * structure
+         * Return value
          */
 
-        process_queue.queue=&queue_head;
+        int ret;
 
         /*
-         * Add the new element representing the current process within the "queues" list to this one
+         * The new barrier and its parameters
          */
 
-        list_add(&process_queue.queue_list,&barrier_tag->queues);
+        struct barrier_struct* barrier;
+        struct ipc_params params;
+
+        if((flags & ~(BARRIER_ADAPTIVE | BARRIER_PREALLOC)) || per_tag_max<0 || per_tag_max>barrier_per_tag_max)
+                return -EINVAL;
 
-        printk(KERN_INFO "BARRIER_MODULE->Adding process to list of tag %d: the address is %lu\n",tag,process_queue);
+        params.key=IPC_PRIVATE;
+        params.flg=flags;
+
+        barrier=allocbarrier(&params,per_tag_max ? per_tag_max : barrier_per_tag_max);
+        if(IS_ERR(barrier))
+                return PTR_ERR(barrier);
 
         /*
-         * Increment the counter of the "barrier_tag" structure because this process is now sleeping
-         * on this tag
+         * Initialize the fields of the permission object that "ipc_addid" would have set: the
+         * lock is still taken to install the structures of the tags and to release the barrier
          */
 
-        barrier_tag->counter++;
+        spin_lock_init(&barrier->barrier_perm.lock);
+        barrier->barrier_perm.deleted=0;
+        barrier->barrier_perm.id=-1;
+        barrier->registry=NULL;
+        INIT_HLIST_NODE(&barrier->key_hash);
+
+        ret=anon_inode_getfd("[barrier]",&barrier_local_fops,barrier,O_RDONLY | O_CLOEXEC);
+        if(ret<0)
+                barrier_free_rcu(&barrier->rcu);
+
+        pr_debug("BARRIER_MODULE->New local barrier at address %p with file descriptor %d\n",barrier,ret);
+
+        return ret;
+}
+
+/*
+ * Execute the entries of a batch in order, writing the outcome of each of them into its
+ * "result" field: an entry failing doesn't stop the batch, while a sleep ends it
+ *
+ * @uarg: user space address of the argument of BARRIER_IOC_BATCH
+ *
+ * Returns the number of entries executed, -EINVAL in case the number of entries is not valid
+ * or -EFAULT in case the first entry can't be copied. An entry that can't be copied, or whose
+ * result can't be written, ends the batch: the entries executed so far have taken effect, so
+ * their number is returned, and -EFAULT only in case none has been executed
+ */
+
+long barrier_batch(struct barrier_batch_arg __user* uarg){
 
         /*
-         * Release the lock on the permission object
+         * Argument of the command, user space address of the current entry and its copy
          */
 
-        barrier_unlock(barrier);
+        struct barrier_batch_arg batch;
+        struct barrier_batch_entry __user* uentry;
+        struct barrier_batch_entry entry;
 
         /*
-         * Put the current process to sleep on its own wait queue: it is woken up when the sleeping
-         * variable of the barrier_tag structure is set to "true" by another process
-         *
-         * Also we want the process to exit from the wait queue when an interrupt comes, so we
-         * use the "interruptible version" of the wait_event function
-         *
-         * The return value is -ERESTARTSYS if a signal came to wake up the process, 0 if it
-         * is waken up because the sleeping condition evaluated to true
+         * Index of the current entry
          */
 
-        ret=wait_event_interruptible(queue_head,barrier_tag->sleeping);
+        u32 i;
 
-        /*
-         * In case of interrupt we have to clean the list of "process_queue" structure within the
-         * barrier_tag element
-         */
+        if(copy_from_user(&batch,uarg,sizeof(batch)))
+                return -EFAULT;
+        if(!batch.count || batch.count>BARRIER_BATCH_MAX)
+                return -EINVAL;
 
-        if(ret==-ERESTARTSYS){
+        uentry=(struct barrier_batch_entry __user*)(unsigned long)batch.entries;
+        for(i=0;i<batch.count;i++,uentry++){
+                if(copy_from_user(&entry,uentry,sizeof(entry)))
+                        return i ? i : -EFAULT;
+
+                switch(entry.op){
+                        case BARRIER_OP_GET:
+                                entry.result=sys_get_barrier(entry.key,entry.flags);
+                                break;
+                        case BARRIER_OP_AWAKE:
+                                entry.result=sys_awake_barrier(entry.bd,entry.tag);
+                                break;
+                        case BARRIER_OP_RELEASE:
+                                entry.result=sys_release_barrier(entry.bd);
+                                break;
+                        case BARRIER_OP_SLEEP:
+                                entry.result=sys_sleep_on_barrier(entry.bd,entry.tag);
+                                break;
+                        default:
+                                entry.result=-EINVAL;
+                }
 
                 /*
-                 * Return -EINTR if the system call gets interrupted, because -ERESTARTSYS would not
-                 * be visible to the User Process and is used by the kernel for internal use to specify
-                 * whether an interrupted system call should be reissued after the signal handler
-                 * termination
+                 * The entry has been executed even if its result can't be written
                  */
 
-                list_del(&process_queue.queue_list);
-                ret=-EINTR;
+                if(put_user(entry.result,&uentry->result) || entry.op==BARRIER_OP_SLEEP)
+                        return i+1;
         }
 
-        /*
-         * Return the outcome of the system call
-         */
+        return batch.count;
+}
 
-        printk(KERN_INFO "System call sys_sleep_on_barrier returned this value:%d\n",ret);
-        return ret;
+/*
+ * Handle the ioctl commands of the device: copy the argument of the command from user space
+ * and invoke the corresponding kernel service routine. The barriers are not related to the
+ * file the command is issued on, so any file descriptor of the device can be used
+ *
+ * @file: file of the device
+ * @cmd: the ioctl command
+ * @arg: user space address of the argument of the command, or the IPC identifier of the
+ *       barrier for BARRIER_IOC_RELEASE
+ *
+ * Returns the value of the kernel service routine, -EFAULT in case the argument can't be
+ * copied or -ENOTTY in case the command is unknown
+ */
+
+long barrier_ioctl(struct file* file,unsigned int cmd,unsigned long arg){
+
+        /*
+         * User space address of the argument and its copies, one for each kind of command
+         */
+
+        void __user* uarg=(void __user*)arg;
+        struct barrier_get_arg get;
+        struct barrier_tag_arg tag;
+        struct barrier_mask_arg mask;
+        struct barrier_threshold_arg threshold;
+        struct barrier_timeout_arg timeout;
+        struct barrier_awake_n_arg awake_n;
+
+        /*
+         * Timeout converted to the kernel representation
+         */
+
+        struct timespec ts;
+
+        switch(cmd){
+                case BARRIER_IOC_SLEEP:
+                        if(copy_from_user(&tag,uarg,sizeof(tag)))
+                                return -EFAULT;
+                        return sys_sleep_on_barrier(tag.bd,tag.tag);
+                case BARRIER_IOC_AWAKE:
+                        if(copy_from_user(&tag,uarg,sizeof(tag)))
+                                return -EFAULT;
+                        return sys_awake_barrier(tag.bd,tag.tag);
+                case BARRIER_IOC_SLEEP_MASK:
+                        if(copy_from_user(&mask,uarg,sizeof(mask)))
+                                return -EFAULT;
+                        return sys_sleep_on_barrier_mask(mask.bd,mask.mask);
+                case BARRIER_IOC_AWAKE_MASK:
+                        if(copy_from_user(&mask,uarg,sizeof(mask)))
+                                return -EFAULT;
+                        return sys_awake_barrier_mask(mask.bd,mask.mask);
+                case BARRIER_IOC_THRESHOLD:
+                        if(copy_from_user(&threshold,uarg,sizeof(threshold)))
+                                return -EFAULT;
+                        return sys_set_barrier_threshold(threshold.bd,threshold.tag,threshold.threshold);
+                case BARRIER_IOC_SLEEP_TIMEOUT:
+                        if(copy_from_user(&timeout,uarg,sizeof(timeout)))
+                                return -EFAULT;
+
+                        /*
+                         * The seconds have to fit the "time_t" of the kernel, which may be narrower
+                         */
+
+                        if(timeout.tv_sec!=(time_t)timeout.tv_sec || timeout.tv_nsec!=(long)timeout.tv_nsec)
+                                return -EINVAL;
+                        ts.tv_sec=timeout.tv_sec;
+                        ts.tv_nsec=timeout.tv_nsec;
+                        return sys_sleep_on_barrier_timeout(timeout.bd,timeout.tag,&ts,timeout.flags);
+                case BARRIER_IOC_GET:
+                        if(copy_from_user(&get,uarg,sizeof(get)))
+                                return -EFAULT;
+                        return sys_get_barrier_limit(get.key,get.flags,get.per_tag_max);
+                case BARRIER_IOC_RELEASE:
+                        return sys_release_barrier((int)arg);
+                case BARRIER_IOC_BATCH:
+                        return barrier_batch(uarg);
+                case BARRIER_IOC_WATCH:
+                        if(copy_from_user(&tag,uarg,sizeof(tag)))
+                                return -EFAULT;
+                        return barrier_watch(tag.bd,tag.tag);
+                case BARRIER_IOC_AWAKE_N:
+                        if(copy_from_user(&awake_n,uarg,sizeof(awake_n)))
+                                return -EFAULT;
+                        return sys_awake_barrier_n(awake_n.bd,awake_n.tag,awake_n.n);
+                case BARRIER_IOC_GET_LOCAL:
+                        if(copy_from_user(&get,uarg,sizeof(get)))
+                                return -EFAULT;
+                        return barrier_get_local(get.flags,get.per_tag_max);
+        }
+
+        return -ENOTTY;
 }
 
 /*
- * Wake up all the processes synchronized on a certain tag of the barrier corresponding to the
- * given IPC identifier
+ * Map the page shared with the barrier selected by the offset of the mapping
  *
- * @bd: IPC identifier of the barrier that the process wants to use in order to synchronize
- *      with other processes
- * @tag: index of specific queue of the barrier onto which the process wants to sleep
+ * @file: file of the device
+ * @vma: memory area to map the page into: it has to be exactly one page long and it can't
+ *       be writable, since the content of the page is only updated by the kernel
  *
  * Returns an error code in case something went wrong, 0 otherwise
  */
 
-asmlinkage long sys_awake_barrier(int bd,int tag){
+int barrier_mmap(struct file* file,struct vm_area_struct* vma){
 
         /*
-         * Return value of this system call
+         * Return value
          */
 
         int ret;
 
         /*
-         * Permission object associated to the given IPC identifier (if valid)
-         */
-
-        struct kern_ipc_perm* barrier_perm;
-
-        /*
-         * Barrier associated to the given IPC identifier (if valid)
+         * Barrier associated to the IPC identifier given as offset
          */
 
         struct barrier_struct* barrier;
 
-        /*
-         * Structure corresponding to the given tag within the barrier associated
-         * to the given IPC identifier (if exists)
-         */
-
-        struct barrier_tag* barrier_tag;
-
-        printk(KERN_INFO "System call sys_awake_barrier invoked with params: barrier descriptor=%d tag=%d\n",bd,tag);
+        if(vma->vm_end-vma->vm_start!=PAGE_SIZE || vma->vm_pgoff>INT_MAX)
+                return -EINVAL;
+        if(vma->vm_flags & VM_WRITE)
+                return -EPERM;
+        vma->vm_flags&=~VM_MAYWRITE;
 
         /*
-         * Check if the provided tag is valid (less than 0<=tag<=31):
-         * if not, return -EINVAL
+         * Inserting the page may sleep, so take a reference to the barrier and leave the RCU
+         * read-side critical section: the mapping takes its own reference to the page, which is
+         * therefore not freed as long as it is mapped, even if the barrier is released in the
+         * meantime
          */
 
-        if(tag<0 || tag >31) {
-                printk(KERN_INFO "System call sys_awake_barrier returned this value:%d\n",ret);
-                ret=-EINVAL;
-                return ret;
+        rcu_read_lock();
+        barrier=barrier_find_rcu((int)vma->vm_pgoff);
+        if(!barrier || !atomic_inc_not_zero(&barrier->refcount)){
+                rcu_read_unlock();
+                return -EINVAL;
         }
+        rcu_read_unlock();
 
-        /*
-         * Check if a permission object associated to the provided IPC identifier exists and, if so,
-         * return it in a locked state, otherwise return error code -EINVAL.
-         */
+        ret=vm_insert_page(vma,vma->vm_start,virt_to_page(barrier->shared));
 
-        barrier_perm=ipc_lock_check(barrier_ids, bd);
+        barrier_put(barrier);
+        return ret;
+}
 
-        /*
-         * In case an error code is returned, i.e. no barrier corresponding to the provided id is found,
-         * unlock the ipc_ids structure and return the error
-         */
+/*
+ * Report whether the tag watched by a file descriptor has been woken up since the file
+ * descriptor was created or last read (POLLIN) and whether the barrier has been released
+ * (POLLHUP). Only the number of awakes of the tag is read, so no lock is taken: the structure
+ * of the tag lives as long as the barrier, which the file descriptor keeps alive
+ *
+ * @file: file of the watch
+ * @wait: poll table the wait queue of the tag is added to
+ *
+ * Returns the mask of the events
+ */
 
-        if(IS_ERR(barrier_perm)){
-                ret=PTR_ERR(barrier_perm);
-                printk(KERN_INFO "System call sys_awake_barrier returned this value:%d\n",ret);
-                return ret;
-        }
+unsigned int barrier_watch_poll(struct file* file,poll_table* wait){
 
         /*
-         * Get the instance of a barrier from its permission object using the "container_of" macro:
-         * given a pointer to a member of a structure and the type of the structure itself, it is
-         * possible to get the address of the specific instance of the structure to which given member
-         * is part of
+         * The watch and the mask of events
          */
 
-        barrier=container_of(barrier_perm,struct barrier_struct,barrier_perm);
+        struct barrier_watch* watch=file->private_data;
+        unsigned int mask=0;
 
-        /*
-         * Check if a "barrier_tag" for the given tag exists in this barrier; if not, return error code
-         * -EINVAL,
-         */
+        poll_wait(file,&watch->barrier_tag->poll_queue,wait);
 
-        barrier_tag=findtag(barrier,tag);
-        if(!barrier_tag) {
+        if(ACCESS_ONCE(watch->barrier_tag->awakes)!=ACCESS_ONCE(watch->awakes))
+                mask|=POLLIN | POLLRDNORM;
+        if(ACCESS_ONCE(watch->barrier->barrier_perm.deleted))
+                mask|=POLLHUP;
 
-                /*
-                 * No permission object corresponding to the requested tag exists, so return -EINVAL and
-                 * release the lock on permission object
-                 */
+        return mask;
+}
 
-                barrier_unlock(barrier);
-                printk(KERN_INFO "System call sys_awake_barrier returned this value:%d\n",-EINVAL);
-                return -EINVAL;
-        }
+/*
+ * Read the number of awakes of the tag watched by a file descriptor since it was created or
+ * last read, as an 8-byte integer, waiting for the next awake in case there has been none.
+ * The number of awakes last read is updated with "cmpxchg", so that each awake is returned
+ * by only one of the reads running at the same time on the file descriptor; the awakes are
+ * consumed even if the buffer can't be written
+ *
+ * @file: file of the watch
+ * @buf: user space buffer, at least 8 bytes long
+ * @count: size of the buffer
+ * @ppos: position in the file, unused
+ *
+ * Returns 8, 0 in case the barrier has been released and the tag hasn't been woken up since
+ * the last read, -EINVAL in case the buffer is too small, -EAGAIN in case the file is non
+ * blocking and there's nothing to read or -ERESTARTSYS in case a signal arrives meanwhile
+ */
+
+ssize_t barrier_watch_read(struct file* file,char __user* buf,size_t count,loff_t* ppos){
 
         /*
-         * Wake up all the processes sleeping on the given tag and then remove the associated
-         * object
+         * The watch, the number of awakes of the tag when last read and now, and the number of
+         * awakes since the last read
          */
 
-        awake_tag(barrier_tag);
+        struct barrier_watch* watch=file->private_data;
+        unsigned long seen,current_awakes;
+        u64 awakes;
+
+        if(count<sizeof(awakes))
+                return -EINVAL;
 
         /*
-         * Release the lock on the permission object
+         * Take the awakes since the last read, unless a concurrent read takes them first: in
+         * that case, wait for the next awake as if there had been none
          */
 
-        barrier_unlock(barrier);
+        for(;;){
+                seen=ACCESS_ONCE(watch->awakes);
+                current_awakes=ACCESS_ONCE(watch->barrier_tag->awakes);
+                if(current_awakes!=seen){
+                        if(cmpxchg(&watch->awakes,seen,current_awakes)==seen)
+                                break;
+                        continue;
+                }
+                if(ACCESS_ONCE(watch->barrier->barrier_perm.deleted))
+                        return 0;
+                if(file->f_flags & O_NONBLOCK)
+                        return -EAGAIN;
+                if(wait_event_interruptible(watch->barrier_tag->poll_queue,
+                                ACCESS_ONCE(watch->barrier_tag->awakes)!=ACCESS_ONCE(watch->awakes) ||
+                                ACCESS_ONCE(watch->barrier->barrier_perm.deleted)))
+                        return -ERESTARTSYS;
+        }
 
-        /*
-         * The awakening was successful, so return 0
-         */
+        awakes=current_awakes-seen;
+        if(put_user(awakes,(u64 __user*)buf))
+                return -EFAULT;
 
-        return 0;
+        return sizeof(awakes);
 }
 
 /*
- * Instantiate a new barrier synchronization object
- *
- * @ key: this value is given in order to ask for a certain barrier; if the
- * "IPC_PRIVATE" key is specified, a new barrier is created
- * @flags: flags that determine how the barrier should be created or returned,
- * if it exists. They are:
+ * Stop watching a tag: the tag no longer counts the file descriptor among its waiters and the
+ * reference of the file descriptor to the barrier is dropped
  *
- * 1)"IPC_CREAT": in case no barrier corresponding to the provided key exists, a new barrier is created
- * 2)"IPC_EXCL" | "IPC_CREAT": in case no barrier corresponding to the provided key exists, a new barrier
- * is created, otherwise error "-EEXIST" is returned
- *
- * Returns:
+ * @watch: the watch
  *
- * 1)-ENOMEM, in case the limit for the number of barriers that can be allocated has been reached
- * or if there's not enough memory to allocate a new barrier
- * 2)-ENOSPC, in case the number of barriers in use at the same time has been reached or if no more
- * IDs can be allocated by the IDR subsystem
- * 3)The unique IPC identifier (id) of the instance of barrier corresponding to the key provided or
- * the id of a new instance in case the key is IPC_PRIVATE or the key is not found and the flag "IPC_CREAT"
- * but not flag "IPC_EXCL" are specified
+ * Returns nothing
  */
 
-asmlinkage long sys_get_barrier(key_t key,int flags){
+void barrier_unwatch(struct barrier_watch* watch){
+        struct barrier_struct* barrier=watch->barrier;
+        struct barrier_tag* barrier_tag=watch->barrier_tag;
 
-        /*
-         * Return value of this system call
-         */
+        spin_lock(&barrier_tag->lock);
+        barrier_tag->watchers--;
+        if(!barrier_tag->counter && !barrier_tag->watchers)
+                clearactive(barrier,barrier_tag->tag);
+        publishtag(barrier,barrier_tag);
+        spin_unlock(&barrier_tag->lock);
 
-        int ret;
+        barrier_put(barrier);
+        kfree(watch);
+}
 
-        /*
-         * Number of barrier instantiated before getting a new one
-         */
+/*
+ * Close a file descriptor watching a tag
+ *
+ * @inode: inode of the file
+ * @file: file of the watch
+ *
+ * Returns 0
+ */
 
-        int in_use;
+int barrier_watch_release(struct inode* inode,struct file* file){
+        barrier_unwatch(file->private_data);
+        return 0;
+}
 
-        /*
-         * Parameters to be passed to the "ipcget" function
-         */
+/*
+ * Operations of the file descriptors watching a tag
+ */
 
-        struct ipc_namespace *ns;
-        struct ipc_ops ops;
-        struct ipc_params params;
+struct file_operations barrier_watch_fops={
+        .owner=THIS_MODULE,
+        .poll=barrier_watch_poll,
+        .read=barrier_watch_read,
+        .release=barrier_watch_release,
+};
 
-        /*
-         * Use ipc_namespace of the current process
-         */
+/*
+ * Create a file descriptor watching the given tag of the barrier with the given IPC identifier:
+ * while it is open, the tag counts as having a waiter, so every awake of the tag is recorded
+ * and makes the file descriptor readable, even if no process is sleeping on the tag
+ *
+ * @bd: IPC identifier of the barrier
+ * @tag: tag to be watched
+ *
+ * Returns the new file descriptor, -EINVAL in case the tag or the barrier is not valid,
+ * -ENOMEM in case there's not enough memory left or the error of the creation of the file
+ */
 
-        ns = current->nsproxy->ipc_ns;
+long barrier_watch(int bd,int tag){
 
         /*
-         * Function associated to the creation of a new barrier
+         * Return value
          */
 
-        ops.getnew = newbarrier;
+        int ret;
 
         /*
-         * We don't care about checking permissions for our barriers,
-         * so the function associated to the operation "associate"
-         * simply returns 0 and "more_checks" is set to NULL
-         *
-         * The former has to be set because it is used in the function
-         * "ipc_check_perms"
+         * Barrier and tag to be watched
          */
 
-        ops.associate = barrier_security;
-        ops.more_checks = NULL;
+        struct barrier_struct* barrier;
+        struct barrier_tag* barrier_tag;
 
         /*
-         * The two parameters to request for a new barrier
+         * The watch, private data of the new file
          */
 
-        params.key = key;
-        params.flg = flags;
+        struct barrier_watch* watch;
 
-        printk(KERN_INFO "System call sys_get_barrier invoked with params: key=%d flags=%d\n", key, flags);
+        if(tag<0 || tag>=BARRIER_TAG_SPACE)
+                return -EINVAL;
 
-        /*
-         * Get actual number of barriers
-         */
+        watch=kmalloc(sizeof(*watch),GFP_KERNEL);
+        if(!watch)
+                return -ENOMEM;
 
-        in_use=barrier_ids->in_use;
+        rcu_read_lock();
+        barrier=barrier_find_rcu(bd);
+        barrier_tag=barrier ? gettag(barrier,tag) : ERR_PTR(-EINVAL);
+        if(IS_ERR(barrier_tag)){
+                rcu_read_unlock();
+                kfree(watch);
+                return PTR_ERR(barrier_tag);
+        }
 
-        printk(KERN_INFO "BARRIER_MODULE->Number of barriers before invoking \"ipcget\":%d\n",in_use);
+        spin_lock(&barrier_tag->lock);
+        if(barrier->barrier_perm.deleted){
+                spin_unlock(&barrier_tag->lock);
+                rcu_read_unlock();
+                kfree(watch);
+                return -EINVAL;
+        }
 
         /*
-         * Get a new barrier synchronization object using the above parameters
+         * From now on the tag has a waiter, so awakes are no longer skipped, and the file
+         * descriptor holds a reference to the barrier
          */
 
-        ret = ipcget(ns, barrier_ids, &ops, &params);
-
-        printk(KERN_INFO "BARRIER_MODULE->Number of barriers after invoking \"ipcget\":%d\n",barrier_ids->in_use);
+        barrier_tag->watchers++;
+        setactive(barrier,tag);
+        publishtag(barrier,barrier_tag);
+        watch->barrier=barrier;
+        watch->barrier_tag=barrier_tag;
+        watch->awakes=barrier_tag->awakes;
+        atomic_inc(&barrier->refcount);
+        spin_unlock(&barrier_tag->lock);
+        rcu_read_unlock();
 
-        /*
-         * If a new barrier is successfully instantiated, increase the usage counter of the current
-         * module: this prevent the module from being removed while some processes are using it (i.e.
-         * there is at least one instance of barrier). The counter will be decreased when the barrier
-         * is released.
-         */
+        ret=anon_inode_getfd("[barrier]",&barrier_watch_fops,watch,O_RDONLY | O_CLOEXEC);
+        if(ret<0)
+                barrier_unwatch(watch);
 
-        if(barrier_ids->in_use>in_use){
+        return ret;
+}
 
-                /*
-                 * Increment module counter because there's a new instance of barrier in the system
-                 */
+/*
+ * Operations of the device
+ */
 
-                printk(KERN_INFO "Incrementing usage counter:%d and %d\n",ret,key);
-                try_module_get(THIS_MODULE);
-        }
+struct file_operations barrier_fops={
+        .owner=THIS_MODULE,
+        .unlocked_ioctl=barrier_ioctl,
+        .mmap=barrier_mmap,
+};
 
-        printk(KERN_INFO "System call sys_get_barrier returned this value:%d\n", ret);
+/*
+ * The device itself, with a dynamically assigned minor number
+ */
 
-        /*
-         * Return the result of the system call
-         */
+struct miscdevice barrier_device={
+        .minor=MISC_DYNAMIC_MINOR,
+        .name="barrier",
+        .fops=&barrier_fops,
+};
 
-        return ret;
-}
+/*
+ * BARRIER DEVICE - end
+ */
 
 /*
- * Release a barrier synchronization instance given its IPC identifier
- *
- * @bd: IPC identifier of the barrier to be removed
+ * PROC VIEW - start
  *
- * Returns a code indicating whether the operation was successful or not
+ * The file "/proc/barrier" shows the cumulative counters of the module and, for each
+ * barrier, its key, its IPC identifier, the bitmap of its active dense tags and the number
+ * of processes sleeping on each of its active tags, dense or sparse. Only the barriers of the IPC namespace of the reading process are shown.
+ * Reading it doesn't take the mutex of the registry nor the locks of the barriers: the barriers are visited inside an RCU read-side critical section, so the
+ * content of the file is just a snapshot that may be slightly inconsistent
  */
 
-asmlinkage long sys_release_barrier(int bd){
-
-        /*
-         * Return value of this system call
-         */
+/*
+ * Names of the cumulative counters, in the order of "barrier_stat"
+ */
 
-        int ret;
+char* barrier_stat_names[BARRIER_STATS]={
+        "sleeps",
+        "awakes",
+        "eintr",
+        "enospc",
+        "awake_notag"
+};
 
-        /*
-         * User id of the current owner of the barrier to be removed
-         */
+/*
+ * Callback function invoked on each permission object registered in the idr: print
+ * the state of the corresponding barrier
+ *
+ * @id: id associated to the pointer
+ * @p: the permission object of the barrier
+ * @data: the seq_file to print into
+ *
+ * Returns 0
+ */
 
-        uid_t euid;
+int barrier_show_callback(int id,void* p,void* data){
 
         /*
-         * The permission object of the barrier to be removed
+         * The seq_file, the barrier and the bitmap of its active tags
          */
 
-        struct kern_ipc_perm* barrier_perm;
-
-        printk(KERN_INFO "System call sys_release_barrier invoked with params: barrier descriptor=%d\n",bd);
+        struct seq_file* m=data;
+        struct kern_ipc_perm* perm=p;
+        struct barrier_struct* barrier;
+        u64 active;
 
         /*
-         * Acquire the mutex on the ipc_ids structure of the barriers because we are going
-         * to remove an entry from its IDR object
+         * Tag to be printed, batch of structures of the sparse tags found in the radix tree, their
+         * number and the first tag of the next batch
          */
 
-        down_write(&barrier_ids->rw_mutex);
+        int tag;
+        struct barrier_tag* found[16];
+        int i,n;
+        unsigned long next=BARRIER_TAGS;
 
-        /*
-         * Check if a permission object corresponding to the provided IPC identifier exists and, if so,
-         * return it in a locked state, otherwise return error code -EINVAL.
-         */
+        if(perm->deleted)
+                return 0;
+        barrier=container_of(perm,struct barrier_struct,barrier_perm);
+        active=activetags(barrier);
 
-        barrier_perm=ipc_lock_check(barrier_ids, bd);
+        seq_printf(m,"%10d %10d %#018llx",perm->key,perm->id,active);
+        for(tag=0;tag<BARRIER_TAGS;tag++)
+                if(active & BARRIER_TAG_BIT(tag))
+                        seq_printf(m," %d:%u",tag,ACCESS_ONCE(barrier->shared->tags[tag].sleepers));
 
         /*
-         * In case an error code is returned, i.e. no barrier corresponding to the provided id is found,
-         * unlock the ipc_ids structure and return the error
+         * The sparse tags have no bit in the bitmap nor a slot in the shared page: visit the radix
+         * tree a batch of tags at a time, as "awake_all" does, and print the ones having sleeping
+         * processes
          */
 
-        if(IS_ERR(barrier_perm)){
-                up_write(&barrier_ids->rw_mutex);
-                ret=PTR_ERR(barrier_perm);
-                printk(KERN_INFO "System call sys_release_barrier returned this value:%d\n",ret);
-                return ret;
+        while((n=radix_tree_gang_lookup(&barrier->sparse,(void**)found,next,16))){
+                for(i=0;i<n;i++)
+                        if(ACCESS_ONCE(found[i]->counter))
+                                seq_printf(m," %d:%d",found[i]->tag,ACCESS_ONCE(found[i]->counter));
+                next=found[n-1]->tag+1;
         }
+        seq_putc(m,'\n');
 
-        printk(KERN_INFO "BARRIER_MODULE->Number of barriers after invoking \"freebarrier\":%d\n",barrier_ids->in_use);
-        freebarrier(barrier_perm);
-        printk(KERN_INFO "BARRIER_MODULE->Number of barriers after invoking \"freebarrier\":%d\n",barrier_ids->in_use);
+        return 0;
+}
 
-        /*
-         * Release the mutex of the ipc_ids structure
-         */
+/*
+ * Print the content of "/proc/barrier"
+ *
+ * @m: the seq_file to print into
+ * @v: unused
+ *
+ * Returns 0
+ */
 
-        up_write(&barrier_ids->rw_mutex );
+int barrier_proc_show(struct seq_file* m,void* v){
 
         /*
-         * The function was successful, so return 0
+         * Counter to be printed, CPU whose counters have to be summed up and total value
          */
 
-        ret=0;
-
-
-        printk(KERN_INFO "System call sys_release_barrier returned this value:%d\n",ret);
+        int stat,cpu;
+        unsigned long total;
 
         /*
-         * One more thing to do: decrease the usage counter of the module, otherwise it won't
-         * be ever possible to remove it
+         * Registry of the barriers of the namespace of the reading process, the only ones shown
          */
 
-        module_put(THIS_MODULE);
+        struct barrier_ns* registry;
 
-        /*
-         * Return 0
-         */
+        for(stat=0;stat<BARRIER_STATS;stat++){
+                total=0;
+                for_each_possible_cpu(cpu)
+                        total+=per_cpu(barrier_stats,cpu).count[stat];
+                seq_printf(m,"%s %lu\n",barrier_stat_names[stat],total);
+        }
 
-        return ret;
+        seq_printf(m,"\n%10s %10s %18s tag:sleepers\n","key","id","active");
+        rcu_read_lock();
+        registry=barrier_ns_find(current->nsproxy->ipc_ns);
+        if(registry)
+                idr_for_each(&registry->ids.ipcs_idr,barrier_show_callback,m);
+        rcu_read_unlock();
+
+        return 0;
+}
+
+int barrier_proc_open(struct inode* inode,struct file* file){
+        return single_open(file,barrier_proc_show,NULL);
 }
 
 /*
- * SYSTEM CALL KERNEL SERVICE ROUTINES - end
+ * Operations of the file "/proc/barrier"
  */
 
+struct file_operations barrier_proc_fops={
+        .owner=THIS_MODULE,
+        .open=barrier_proc_open,
+        .read=seq_read,
+        .llseek=seq_lseek,
+        .release=single_release,
+};
+
 /*
- * INSERT/REMOVE MODULE - start
+ * PROC VIEW - end
  */
 
 /*
  * INSERT MODULE
- * "Dynamically" add system calls to the system:
- * -> replace not implemented system calls (sys_ni_syscall) with custom system calls
+ * Create the structures used to keep track of the barriers and then register the device
+ * "/dev/barrier", whose ioctl commands give access to the barriers
  */
 
 int init_module(void) {
 
         /*
-         * Value stored in the register CR0
+         * Outcome of the registration of the device and bucket of the hash table of the
+         * registries being initialized
          */
 
-        unsigned long cr0;
+        int ret,i;
 
         /*
-         * Find the address of the system call table
+         * Check the limits given as module parameters: barrier identifiers can't exceed IPCMNI
          */
 
-        system_call_table=find_system_call_table();
+        if(barrier_ids_max<=0 || barrier_ids_max>IPCMNI || barrier_per_tag_max<=0 || barrier_sparse_max<0)
+                return -EINVAL;
 
         /*
-         * Get the indexes of the free entries in the system call table,
-         * i.e. those initialized to the address of "sys_ni_syscall".
-         * This is necessary in order to restore the system call table
-         * when the module is removed
+         * The state of the dense tags, one cache line each, has to fit the page shared with user space
          */
 
-        find_free_syscalls(system_call_table,restore);
+        BUILD_BUG_ON(sizeof(struct barrier_shared)>PAGE_SIZE);
 
         /*
-         * In case the CPU has WRITE-PROTECTED MODE enabled, even kernel
-         * thread can't modify read-only pages, such those containing the
-         * system call table => we first have to disable the WRITE-PROTECTED MODE
-         * by clearing the corresponding bit (number 16) in the CR0 register.
+         * Create the slab cache of the structures of the tags
          */
 
-        disable_write_protected_mode(&cr0);
+        barrier_tag_cache=kmem_cache_create("barrier_tag",sizeof(struct barrier_tag),0,SLAB_HWCACHE_ALIGN,NULL);
+        if(!barrier_tag_cache)
+                return -ENOMEM;
 
         /*
-         * Replace system call "sys_ni_syscall" in the system call table
-         * with our custom system calls: we assume that no other process
-         * running on any other CPU ever tries to access the system call
-         * not implemented => if this assumption holds, the following code
-         * is thread-safe
+         * Look up the function dropping a reference to an IPC namespace (see "helper.h"): the
+         * registries of the barriers keep their namespaces alive. Without IPC namespaces there
+         * is only the initial one, which is never freed
          */
 
-        system_call_table[restore[0]]=(unsigned long)sys_get_barrier;
-        system_call_table[restore[1]]=(unsigned long)sys_sleep_on_barrier;
-        system_call_table[restore[2]]=(unsigned long)sys_awake_barrier;
-        system_call_table[restore[3]]=(unsigned long)sys_release_barrier;
+        barrier_put_ipc_ns=(void (*)(struct ipc_namespace*))kallsyms_lookup_name("put_ipc_ns");
+        barrier_init_ipc_ns=(struct ipc_namespace*)kallsyms_lookup_name("init_ipc_ns");
+#ifdef CONFIG_IPC_NS
+        if(!barrier_put_ipc_ns || !barrier_init_ipc_ns){
+                kmem_cache_destroy(barrier_tag_cache);
+                return -ENOENT;
+        }
+#endif
 
         /*
-         * Restore original value of register CR0
+         * The registries of the barriers, one for each IPC namespace, are created when the first
+         * barrier of the namespace is: the hash table only needs to be initialized before the
+         * device is registered, since processes can use the barriers as soon as the device exists
          */
 
-        enable_write_protected_mode(&cr0);
+        for(i=0;i<(1<<BARRIER_NS_HASH_BITS);i++)
+                INIT_HLIST_HEAD(&barrier_namespaces[i]);
 
         /*
-         * Allocate a new structure "ipc_ids" in order to keep track of
-         * all the existing barrier objects as they are created
+         * Register the device giving access to the barriers: the module can't be inserted
+         * without it
          */
 
-        barrier_ids=kmalloc(sizeof(struct ipc_ids), GFP_KERNEL);
+        ret=misc_register(&barrier_device);
+        if(ret){
+                kmem_cache_destroy(barrier_tag_cache);
+                return ret;
+        }
 
         /*
-         * Initialize the newly created "ipc_ids" structure:
-         *
-         * 1-counter of ids in use is set to 0
-         * 2-sequence number is set to 0
-         * 3-mutex is initialized
-         * 4-idr subsystem (to manage ids) is initialized using the function
-         *   "idr_init", which is part of its API
+         * Create the file "/proc/barrier", showing the state of the module
          */
 
-        ipc_init_ids(barrier_ids);
+        if(!proc_create("barrier",0444,NULL,&barrier_proc_fops)){
+                misc_deregister(&barrier_device);
+                kmem_cache_destroy(barrier_tag_cache);
+                return -ENOMEM;
+        }
 
         /*
          * Log message about our just inserted module
          */
 
-        printk(KERN_INFO "Module \"barrier_module\" inserted: index of replaced system calls\nsys_get_barrier:%d\nsys_sleep_on_barrier:%d\nsys_awake_barrier:%d\nsys_release_barrier:%d\n",restore[0],restore[1],restore[2],restore[3]);
+        printk(KERN_INFO "Module \"barrier_module\" inserted: barriers available through /dev/barrier\n");
         return 0;
 
 }
 
 /*
  * REMOVE MODULE
- * Restore the system call table to its original form removing our custom system  calls
+ * Remove the device and release the structures used to keep track of the barriers
  */
 
 void cleanup_module(void) {
 
-        unsigned long cr0;
-
-        /*
-         * In order to restore the system call table, the WRITE-PROTECTED
-         * MODE has to be disabled again temporarily, so first save the
-         * value of the CR0 register
-         */
-
-        disable_write_protected_mode(&cr0);
-
-        /*
-         * Restore system call table to its original shape
-         */
-
-        system_call_table[restore[0]]=not_implemented_syscall;
-        system_call_table[restore[1]]=not_implemented_syscall;
-        system_call_table[restore[2]]=not_implemented_syscall;
-        system_call_table[restore[3]]=not_implemented_syscall;
-
-        /*
-         * Restore value of register CR0
-         */
-
-        enable_write_protected_mode(&cr0);
-
         /*
-         * Remove the ipc_ids structure associated to the barriers
+         * Remove the device and then the registries of the barriers of all the namespaces. The
+         * barriers are woken up by work items, and both the barriers and the registries are freed
+         * by RCU callbacks, which all have to run before the slab cache of the tags (and the
+         * module code) goes away
          */
 
+        remove_proc_entry("barrier",NULL);
+        misc_deregister(&barrier_device);
+        cancel_delayed_work_sync(&barrier_ns_reap_work);
         remove_ids();
-
-        printk(KERN_INFO "BARRIER_MODULE->Released memory allocated for the structure ipc_ids at address %lu\n",barrier_ids);
+        flush_scheduled_work();
+        rcu_barrier();
+        kmem_cache_destroy(barrier_tag_cache);
 
         printk(KERN_INFO "Module \"barrier_module\" removed\n");
 
@@ -7,34 +7,173 @@
  *
  * BARRIER_CREATE: the barrier has to be created if it doesn't exist
  * BARRIER_EXCL: an error code has to be returned if BARRIER_CREATE is invoked and the barrier already exists
+ * BARRIER_ADAPTIVE: when the barrier is created, processes going to sleep on it first spin for a short
+ * time, tuned on the basis of the time they recently waited, and only then actually go to sleep
+ * BARRIER_PREALLOC: the structures of all the dense tags are allocated when the barrier is created,
+ * rather than the first time a process goes to sleep on each of them, so that going to sleep on a
+ * dense tag never allocates memory and never fails with -ENOMEM. The sparse tags can't be reserved in
+ * advance, since any of them may be used: the structure of a sparse tag is still allocated the first
+ * time it is used, which setting its threshold before going to sleep on it does too
+ *
+ * BARRIER_ADAPTIVE and BARRIER_PREALLOC lie above the bits of the IPC flags (e.g. IPC_DIPC and
+ * IPC_OWN), so that they can't be mistaken for any of them
  *
  */
 
 #define BARRIER_CREATE (IPC_CREAT)
 #define BARRIER_EXCL (IPC_EXCL)
 #define BARRIER_PRIVATE (IPC_PRIVATE)
+#define BARRIER_ADAPTIVE 0100000000
+#define BARRIER_PREALLOC 0200000000
+
+/*
+ * Maximum time (in nanoseconds) a process spins on an adaptive barrier before going to sleep:
+ * a process spins for twice the average time processes recently waited on the barrier, but
+ * it doesn't spin at all if this average is greater than this limit
+ */
+
+#define BARRIER_SPIN_MAX_NS 50000
+
+/*
+ * Flag of "sleep_on_barrier_timeout": the timeout is an absolute value of the
+ * CLOCK_MONOTONIC clock rather than an interval relative to the current time
+ */
+
+#define BARRIER_TIMEOUT_ABS 1
+
+/*
+ * The number of dense PRIORITY SYNCHRONIZATION TAGS, going from 0 to BARRIER_TAGS-1:
+ * their structures are found by indexing an array, they have a bit in the bitmaps
+ * used by the "mask" system calls and their state is copied into the shared page
+ */
+
+#define BARRIER_TAGS 64
+
+/*
+ * The number of all the legal tags, going from 0 to BARRIER_TAG_SPACE-1: the sparse
+ * tags, from BARRIER_TAGS on, can only be used one at a time (sleep, awake and
+ * threshold) and their structures are kept in a radix tree
+ */
+
+#define BARRIER_TAG_SPACE 65536
+
+/*
+ * Default maximum number of sparse tags used on a barrier: the structure of a sparse tag
+ * lives as long as the barrier, so without a limit a single process could pin a structure
+ * for each of the tags up to BARRIER_TAG_SPACE. The actual value is given by the module
+ * parameter "barrier_sparse_max"
+ */
+
+#define BARRIER_SPARSE_MAX 1024
+
+/*
+ * Bit corresponding to the given dense tag in the bitmap of the tags having
+ * sleeping processes
+ */
+
+#define BARRIER_TAG_BIT(tag) (1ULL<<(tag))
 
 /*
- * The number of PRIORITY SYNCHRONIZATION TAGS: legal values for these
- * tags go from 0 to BARRIER_TAGS-1
+ * Mask selecting all the dense tags greater than or equal to the given one, to be
+ * used with "awake_barrier_mask": it is empty from BARRIER_TAGS on and full up to 0,
+ * since shifting by a negative amount or by the width of the type is undefined
  */
 
-#define BARRIER_TAGS 32
+#define BARRIER_TAGS_FROM(tag) ((tag)<=0 ? ~0ULL : (tag)>=BARRIER_TAGS ? 0ULL : ~0ULL<<(tag))
 
 /*
- * Maximum number of processes synchronized on a tag: we want to avoid that
- * list of wait queue heads grow indefinitely
+ * Maximum number of tags whose generations a process sleeping on a set of tags records on its
+ * kernel stack: the generations of larger sets are allocated (see "sleep_on_barrier_mask")
+ */
+
+#define BARRIER_MASK_STACK_TAGS 8
+
+/*
+ * Default maximum number of processes synchronized on a tag: we want to avoid that
+ * list of wait queue heads grow indefinitely. The actual value is given by the module
+ * parameter "barrier_per_tag_max" and a smaller one can be chosen for each barrier
+ * when it is created (see "get_barrier_limit")
  */
 
 #define BARRIER_PER_TAG_MAX 128
 
 /*
- * Maximum number of IDs for the barrier synchronization object: there can be at most
- * BARRIER_IDS_MAX different instances at a time
+ * Default maximum number of IDs for the barrier synchronization object: there can be
+ * at most this number of different instances at a time. The actual value is given by
+ * the module parameter "barrier_ids_max", which can't exceed IPCMNI
  */
 
 #define BARRIER_IDS_MAX 128
 
+/*
+ * The registries of the barriers of the IPC namespaces (see "barrier_ns") are kept in a hash
+ * table of 2^BARRIER_NS_HASH_BITS buckets indexed by the address of the namespace
+ */
+
+#define BARRIER_NS_HASH_BITS 5
+
+/*
+ * The barriers of a namespace having a key other than IPC_PRIVATE are indexed by key in a
+ * hash table of 2^BARRIER_KEY_HASH_BITS buckets (see "get_barrier")
+ */
+
+#define BARRIER_KEY_HASH_BITS 8
+
+/*
+ * Interval (in seconds) between two visits of the registries of the barriers looking for the
+ * IPC namespaces whose processes have all exited (see "barrier_ns_reap")
+ */
+
+#define BARRIER_NS_REAP_SECONDS 10
+
+/*
+ * Default minimum number of processes sleeping on a tag for an awake to fan out: instead of
+ * waking up all of them from the awaking process, the awake only wakes up the first
+ * BARRIER_FANOUT processes of the queue and each woken process wakes up the next
+ * BARRIER_FANOUT ones, so the wake up work is spread over the woken processes and their CPUs.
+ * The actual value is given by the module parameter "barrier_fanout_min", 0 disables it
+ */
+
+#define BARRIER_FANOUT_MIN 32
+
+/*
+ * Number of processes woken up by each step of a fanned out awake
+ */
+
+#define BARRIER_FANOUT 4
+
+/*
+ * Cumulative counters of the module, shown by "/proc/barrier": they are kept per CPU,
+ * so that updating them never bounces a cache line between CPUs
+ *
+ * BARRIER_STAT_SLEEPS: processes that went to sleep on a barrier
+ * BARRIER_STAT_AWAKES: tags that have been woken up
+ * BARRIER_STAT_EINTR: sleeps interrupted by a signal
+ * BARRIER_STAT_ENOSPC: sleeps rejected because the limit of processes of a tag was reached
+ * BARRIER_STAT_AWAKE_NOTAG: awakes that found no process sleeping on the requested tags
+ */
+
+enum barrier_stat
+{
+        BARRIER_STAT_SLEEPS,
+        BARRIER_STAT_AWAKES,
+        BARRIER_STAT_EINTR,
+        BARRIER_STAT_ENOSPC,
+        BARRIER_STAT_AWAKE_NOTAG,
+        BARRIER_STATS
+};
+
+struct barrier_stats
+{
+        unsigned long count[BARRIER_STATS];
+};
+
+/*
+ * Kernel service routines of the operations on the barriers: they are invoked by the
+ * handler of the ioctl commands of the device "/dev/barrier" (see "barrier_ioctl.h"),
+ * which copies their arguments from user space
+ */
+
 /*
  * Kernel service routine to get the an instance of a barrier.
  * Parameters:
@@ -42,7 +181,62 @@
  * 2- int flags: flags to define the action to perform on the barrier
  */
 
-asmlinkage long sys_get_barrier(key_t key,int flags);
+long sys_get_barrier(key_t key,int flags);
+
+/*
+ * Kernel service routine to get an instance of a barrier, limiting the number of
+ * processes sleeping on each of its tags in case it is created.
+ * Parameters:
+ * 1- key_t key: used to uniquely identify the instance of the barrier
+ * 2- int flags: flags to define the action to perform on the barrier
+ * 3- int per_tag_max: maximum number of processes sleeping on a tag, from 1 to the
+ * module parameter "barrier_per_tag_max"; 0 means the module parameter itself
+ */
+
+long sys_get_barrier_limit(key_t key,int flags,int per_tag_max);
+
+/*
+ * Kernel service routine to wake up all the processes sleeping on a set of dense tags
+ * of a barrier.
+ * Parameters:
+ * 1- int bd: IPC identifier of the barrier
+ * 2- u64 mask: bitmap of the tags to be woken up, BARRIER_TAG_BIT(tag) for each tag
+ */
+
+long sys_awake_barrier_mask(int bd,u64 mask);
+
+/*
+ * Kernel service routine to put the current process to sleep on a set of dense tags
+ * of a barrier, until any of them is woken up.
+ * Parameters:
+ * 1- int bd: IPC identifier of the barrier
+ * 2- u64 mask: bitmap of the tags to sleep on, BARRIER_TAG_BIT(tag) for each tag
+ */
+
+long sys_sleep_on_barrier_mask(int bd,u64 mask);
+
+/*
+ * Kernel service routine to set the number of sleeping processes that automatically
+ * wakes up a tag of a barrier.
+ * Parameters:
+ * 1- int bd: IPC identifier of the barrier
+ * 2- int tag: the tag
+ * 3- int threshold: number of processes, 0 to disable the automatic awake
+ */
+
+long sys_set_barrier_threshold(int bd,int tag,int threshold);
+
+/*
+ * Kernel service routine to put the current process to sleep on a tag of a barrier
+ * for at most a given time.
+ * Parameters:
+ * 1- int bd: IPC identifier of the barrier
+ * 2- int tag: the tag
+ * 3- const struct timespec* timeout: relative timeout, or absolute CLOCK_MONOTONIC time
+ * 4- int flags: BARRIER_TIMEOUT_ABS for an absolute time
+ */
+
+long sys_sleep_on_barrier_timeout(int bd,int tag,const struct timespec* timeout,int flags);
 
 /*
  * Simplified custom version of the "kern_ipc_perm" structure used by
@@ -82,48 +276,206 @@ struct ipc_params{
 };
 
 /*
- * Element associated to a process sleeping on a certain tag
+ * Structure that keeps track of all the processes sleeping on a certain synchronization
+ * tag
+ *
+ * counter: number of processes sleeeping on this tag; this can't exceed the limit of the
+ * barrier (the field "per_tag_max" of the barrier)
+ *
+ * tag: the synchronization tag corresponding to this structure
+ *
+ * threshold: number of sleeping processes that automatically wakes up the tag (counting
+ * barrier): the process whose arrival makes the counter reach the threshold wakes up all the
+ * others and doesn't go to sleep at all. 0 means that the tag is only woken up explicitly
+ * by "awake_barrier"; the threshold is kept for all the synchronization phases of the tag
+ *
+ * generation: number of times the tag has been woken up; a process going to sleep on the tag
+ * records its value and it is woken up as soon as the value changes. Since the structure is
+ * reused for all the synchronization phases of the tag, this makes sure that a process
+ * arriving after an awake can't hide the awake to the processes of the previous phase
+ *
+ * queue: the wait queue shared by all the processes synchronized on this tag: they all sleep
+ * on it, so that they can be woken up at once by a single call to "wake_up_all". They are
+ * queued as exclusive waiters in arrival order, so that "awake_barrier_n" can also release
+ * only the first N of them (see "barrier_waiter")
+ *
+ * lock: protects all the other fields of the structure, the bit of the tag in the bitmap of
+ * the barrier and the state of the tag in the shared page: each tag has its own lock, so
+ * processes working on different tags of the same barrier never wait for each other. The
+ * lock on the barrier is only taken to install the structure of a tag and to release the
+ * barrier, which in turn takes the lock of each tag, so it always comes first
+ *
+ * watchers: number of file descriptors watching the tag (see "barrier_watch"): as long as
+ * there is at least one of them, the tag can be woken up even if no process is sleeping on it
  *
- * queue_list: list element, used to connect the structure to the list "queues" within the barrier_tag
- * structure
+ * poll_queue: wait queue of the processes polling or reading the file descriptors watching
+ * the tag, kept apart from "queue" so that an awake only touches it when there are watchers
  *
- * queue: pointer to the wait queue head of the wait queue stored in the Kernel Mode Stack of a sleeping
- * process synchronized on this tag
+ * awakes: number of times the tag has been woken up by an awake, read by the file descriptors
+ * watching the tag: unlike "generation", it doesn't change when the barrier is released
+ *
+ * The structures are allocated from the slab cache "barrier_tag", which aligns each of them
+ * to its own cache line, so that processes working on different tags of the same barrier
+ * don't bounce the same cache line between CPUs
  */
 
-struct process_queue
+struct barrier_tag
 {
-        struct list_head queue_list;
-        wait_queue_head_t* queue;
+        int counter;
+        int tag;
+        int threshold;
+        unsigned long generation;
+        wait_queue_head_t queue;
+        spinlock_t lock;
+        int watchers;
+        wait_queue_head_t poll_queue;
+        unsigned long awakes;
 };
 
 /*
- * Structure that keeps track of all the processes sleeping on a certain synchronization
- * tag
+ * Entry of a process sleeping on the wait queue of a tag
  *
- * counter: number of processes sleeeping on this tag; this has to be smaller than the limit
- * represented by the constant BARRIER_PER_TAG_MAX
+ * wait: the entry of the wait queue, whose wake function is "barrier_wake"
+ * generation: generation of the tag when the process went to sleep on it
+ * released: set by "awake_barrier_n" holding the lock on the tag, in case it releases
+ * the process without waking up the whole tag (the generation doesn't change then)
+ * cascade: set holding the lock of the wait queue in case the process has been woken up by a
+ * fanned out awake, so that it has to wake up the next processes of the queue in its turn
+ */
+
+struct barrier_waiter
+{
+        wait_queue_t wait;
+        unsigned long generation;
+        int released;
+        int cascade;
+};
+
+/*
+ * Key passed to "barrier_wake" by "awake_barrier_n"
  *
- * tag: the synchronization tag corresponding to this structure
+ * generation: current generation of the tag: only the processes that went to sleep in the
+ * current synchronization phase are released, the ones left in the queue by a fanned out
+ * awake still in progress are woken up as part of that awake
+ * released: number of processes released so far
+ */
+
+struct barrier_wake_key
+{
+        unsigned long generation;
+        int released;
+};
+
+/*
+ * Entry of a process sleeping on a set of tags on the wait queue of the barrier
  *
- * tag_list: list element, used to connect the structure to the list "tags" within the barrier
+ * wait: the entry of the wait queue, whose wake function is "barrier_mask_wake"
+ * mask: bitmap of the tags the process is sleeping on
+ */
+
+struct barrier_mask_waiter
+{
+        wait_queue_t wait;
+        u64 mask;
+};
+
+/*
+ * State of a file descriptor watching a tag of a barrier: it becomes readable as soon as the
+ * tag is woken up after the file descriptor has been created or last read
  *
- * queues: head of a list of structures, each containing a pointer to the wait queue into which
- * a process is sleeping in order to synchronize itself on the this tag
+ * barrier: the barrier, whose reference is held by the file descriptor
+ * barrier_tag: structure of the watched tag, which lives as long as the barrier
+ * awakes: number of awakes of the tag when the file descriptor was created or last read,
+ * updated with "cmpxchg" so that concurrent reads don't return the same awakes twice
+ */
+
+struct barrier_watch
+{
+        struct barrier_struct* barrier;
+        struct barrier_tag* barrier_tag;
+        unsigned long awakes;
+};
+
+/*
+ * Create a file descriptor watching a tag of a barrier (see "barrier_watch" in barrier.c):
+ * declared here because the ioctl dispatcher precedes the file operations of the watch
+ */
+
+long barrier_watch(int bd,int tag);
+
+/*
+ * State of a dense tag in the page shared with user space, updated by the kernel holding
+ * the lock on the tag: each tag has its own 64-byte cache line, so that processes working
+ * on different tags don't bounce the same line between CPUs
  *
- * sleeping: boolean value that has to be changed from the "sleep_on_barrier" system call in order
- * to wake up all the processes synchronized on the this tag
+ * generation: generation of the tag, i.e. the number of times it has been woken up (only
+ * the 32 least significant bits)
  *
+ * sleepers: number of processes sleeping on the tag
  *
+ * watchers: number of file descriptors watching the tag: an awake of the tag is needed
+ * as long as any of the two is not 0
  */
 
-struct barrier_tag
+struct barrier_shared_tag
 {
-        int counter;
-        int tag;
-        struct list_head tag_list;
-        struct list_head queues;
-        bool sleeping;
+        u32 generation;
+        u32 sleepers;
+        u32 watchers;
+        u32 pad[13];
+};
+
+/*
+ * Content of the page shared between the kernel and the user space processes mapping the
+ * device "/dev/barrier" at offset bd*PAGE_SIZE (read-only): it holds a copy of the state
+ * of each dense tag of the barrier with IPC identifier bd
+ *
+ * A process can then skip "awake_barrier" when no process is waiting on the tag, or spin
+ * for a short time waiting for the generation of a tag to change before going to sleep
+ */
+
+struct barrier_shared
+{
+        struct barrier_shared_tag tags[BARRIER_TAGS];
+};
+
+/*
+ * Registry of the barriers of an IPC namespace: each namespace has its own IDs, its own limit
+ * of barriers and its own mutex, so processes of different namespaces (e.g. containers) never
+ * see each other's barriers nor contend on their creation and release. A registry is created
+ * when a process of the namespace gets a barrier for the first time and it is freed once no
+ * barrier of the namespace is left, or once no process is left in the namespace
+ *
+ * hash: entry in the hash table of the registries, indexed by namespace
+ *
+ * ns: the IPC namespace, to which the registry holds a reference
+ *
+ * ids: the ipc_ids structure keeping track of the barriers of the namespace on the basis of
+ * their IDs
+ *
+ * keys: hash table of the barriers of the namespace having a key other than IPC_PRIVATE,
+ * indexed by key: it is updated holding the mutex of "ids" as writer and read in RCU read-side
+ * critical sections, so getting an existing barrier takes no lock
+ *
+ * refcount: one reference for each barrier in "ids" plus one for each operation using the
+ * registry; it is removed from the hash table as soon as the last one is dropped
+ *
+ * dead: set holding the lock on the hash table of the registries once the reference of the
+ * registry is the only one left to the namespace, i.e. all the processes of the namespace
+ * have exited: its barriers are then released (see "barrier_ns_reap")
+ *
+ * rcu: used to free the registry after a grace period, since it is looked up in RCU
+ * read-side critical sections
+ */
+
+struct barrier_ns{
+        struct hlist_node hash;
+        struct ipc_namespace* ns;
+        struct ipc_ids ids;
+        struct hlist_head keys[1<<BARRIER_KEY_HASH_BITS];
+        atomic_t refcount;
+        int dead;
+        struct rcu_head rcu;
 };
 
 /*
@@ -133,30 +485,84 @@ struct barrier_tag
  * is the ID that is assigned to (and only to) the instance of barrier by
  * the ipc_ids structure
  *
- * tags: head of the list of "barrier_tag" structures, one for each different TAG
- * requested using the system call "sleep_on_barrier(bd,TAG)"
+ * registry: registry of the IPC namespace the barrier belongs to, to which the
+ * barrier holds a reference until it is released
+ *
+ * key_hash: entry in the hash table of the keys of the registry, unless the key of
+ * the barrier is IPC_PRIVATE
+ *
+ * active: bitmap of the dense tags having at least one sleeping process or
+ * watching file descriptor: the bit of a tag is updated with atomic bit operations
+ * holding the lock on the tag, and it is the same as BARRIER_TAG_BIT(tag) once the
+ * bitmap is read as a 64-bit mask (see "activetags")
+ *
+ * refcount: number of references to the barrier, i.e. one for the IDR of the
+ * ipc_ids structure (handed over to the release until the tags have been woken
+ * up) plus one for each process sleeping on the barrier and one for each file
+ * descriptor watching one of its tags; the memory of the barrier is released by
+ * whoever drops the last reference, so that no sleeping process is left with a
+ * wait queue that no longer exists
+ *
+ * mask_sleepers: number of processes sleeping on a set of tags of the barrier
+ * (see "sleep_on_barrier_mask"), incremented before they take the lock of any tag
+ *
+ * mask_queue: wait queue shared by the processes sleeping on a set of tags: the
+ * awake of a tag only wakes up the processes whose set includes it
+ *
+ * shared: page shared with user space (see "barrier_shared")
+ *
+ * flags: flags given when the barrier was created that determine its behaviour
+ * (BARRIER_ADAPTIVE, BARRIER_PREALLOC)
+ *
+ * per_tag_max: maximum number of processes sleeping on each tag of the barrier, chosen
+ * when the barrier is created
+ *
+ * wait_ns: for adaptive barriers, moving average of the time (in nanoseconds) processes
+ * waited before their tag was woken up; it is updated without holding any lock, since it
+ * is only used to tune the time processes spin before going to sleep
+ *
+ * rcu: used to free the barrier after the last reference has been dropped, once
+ * the RCU readers that may still be looking at it (see "/proc/barrier") are done
+ *
+ * release_work: once the barrier has been removed from the IDR, wakes up its tags
+ * and drops the reference of the IDR out of the context of "release_barrier"
+ * (see "barrier_release_work")
+ *
+ * tags: pointer to the "barrier_tag" structure of each of the BARRIER_TAGS dense
+ * tags, NULL until a process goes to sleep on the tag for the first time (or the
+ * threshold of the tag is set), unless the barrier has been created with
+ * BARRIER_PREALLOC; once allocated, a structure lives as long as the barrier.
+ * Tags having sleeping processes always have their structure
+ *
+ * sparse: radix tree of the structures of the sparse tags (from BARRIER_TAGS to
+ * BARRIER_TAG_SPACE-1) that have been used, indexed by tag; they are always
+ * allocated the first time they are used and live as long as the barrier too
+ *
+ * sparse_count: number of structures in "sparse", at most the module parameter
+ * "barrier_sparse_max"
+ *
+ * Both "tags" and "sparse" are filled holding the lock on the barrier and read in
+ * RCU read-side critical sections, without any lock
  */
 
 struct barrier_struct{
 
         struct kern_ipc_perm barrier_perm;
-        struct list_head tags;
-};
-
-/*
- * Structure that holds some ipc operations. This structure is used to unify
- * the calls to sys_msgget(), sys_semget(), sys_shmget()
- *      . routine to call to create a new ipc object. Can be one of newque,
- *        newary, newseg
- *      . routine to call to check permissions for a new ipc object.
- *        Can be one of security_msg_associate, security_sem_associate,
- *        security_shm_associate
- *      . routine to call for an extra check if needed
- */
-struct ipc_ops {
-        int (*getnew) (struct ipc_namespace *, struct ipc_params *);
-        int (*associate) (struct kern_ipc_perm *, int);
-        int (*more_checks) (struct kern_ipc_perm *, struct ipc_params *);
+        struct barrier_ns* registry;
+        struct hlist_node key_hash;
+        unsigned long active[BITS_TO_LONGS(BARRIER_TAGS)];
+        atomic_t refcount;
+        atomic_t mask_sleepers;
+        wait_queue_head_t mask_queue;
+        struct barrier_shared* shared;
+        int flags;
+        int per_tag_max;
+        unsigned long wait_ns;
+        struct rcu_head rcu;
+        struct work_struct release_work;
+        struct barrier_tag* tags[BARRIER_TAGS];
+        struct radix_tree_root sparse;
+        int sparse_count;
 };
 
 
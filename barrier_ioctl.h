@@ -0,0 +1,221 @@
+#ifndef BARRIERSYNCHRONIZATION_BARRIER_IOCTL_H
+#define BARRIERSYNCHRONIZATION_BARRIER_IOCTL_H
+
+/*
+ * Interface of the device "/dev/barrier", shared by the module and the user space programs:
+ * every operation on the barriers is an ioctl on a file descriptor of the device, whose
+ * argument is a pointer to one of the structures below. The value returned by the ioctl is
+ * the one described for each operation, or -1 with errno set in case of error
+ */
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * Magic number of the ioctl commands of the device
+ */
+
+#define BARRIER_IOC_MAGIC 'b'
+
+/*
+ * Argument of BARRIER_IOC_GET: get the barrier with the given key
+ *
+ * key: key of the barrier, IPC_PRIVATE for a new one
+ * flags: IPC_CREAT, IPC_EXCL, BARRIER_ADAPTIVE, BARRIER_PREALLOC and the permission bits: any
+ * other flag is rejected with -EINVAL
+ * per_tag_max: maximum number of processes sleeping on each tag in case the barrier is created,
+ * 0 for the limit of the module
+ *
+ * Returns the IPC identifier of the barrier
+ */
+
+struct barrier_get_arg
+{
+        __s32 key;
+        __s32 flags;
+        __s32 per_tag_max;
+};
+
+/*
+ * BARRIER_IOC_GET_LOCAL takes a "barrier_get_arg" too, whose key is ignored: it creates a
+ * barrier private to the calling process, to synchronize its threads, and returns a new file
+ * descriptor of the barrier. The barrier is not registered in the IPC namespace, so it isn't
+ * visible to other processes nor counted in the limit of the barriers, and it is released as
+ * soon as the file descriptor is closed or the process exits (BARRIER_IOC_RELEASE doesn't
+ * apply to it). The other commands take BARRIER_LOCAL_BD(fd) as the identifier "bd" of the
+ * barrier, and its shared page is mapped from the file descriptor itself at offset 0
+ */
+
+#define BARRIER_LOCAL_BD(fd) (-2-(fd))
+#define BARRIER_LOCAL_FD(bd) (-2-(bd))
+
+/*
+ * Argument of BARRIER_IOC_SLEEP, BARRIER_IOC_AWAKE and BARRIER_IOC_WATCH: sleep on, wake up or
+ * watch a tag of a barrier
+ *
+ * bd: IPC identifier of the barrier
+ * tag: the tag
+ *
+ * Returns 0, or a new file descriptor for BARRIER_IOC_WATCH: it becomes readable (POLLIN) as
+ * soon as the tag is woken up after the file descriptor has been created or last read, and
+ * reading it returns the number of awakes meanwhile as an 8-byte integer. It also reports
+ * POLLHUP once the barrier has been released
+ */
+
+struct barrier_tag_arg
+{
+        __s32 bd;
+        __s32 tag;
+};
+
+/*
+ * Argument of BARRIER_IOC_SLEEP_MASK and BARRIER_IOC_AWAKE_MASK: sleep on or wake up a set of
+ * dense tags of a barrier
+ *
+ * bd: IPC identifier of the barrier
+ * mask: bitmap of the tags, BARRIER_TAG_BIT(tag) for each of them
+ *
+ * Returns the tag that woke up the process (sleep) or the number of tags woken up (awake)
+ */
+
+struct barrier_mask_arg
+{
+        __s32 bd;
+        __u32 pad;
+        __u64 mask;
+};
+
+/*
+ * Argument of BARRIER_IOC_THRESHOLD: set the number of sleeping processes that automatically
+ * wakes up a tag of a barrier
+ *
+ * bd: IPC identifier of the barrier
+ * tag: the tag
+ * threshold: number of processes, 0 to disable the automatic awake
+ *
+ * Returns 0
+ */
+
+struct barrier_threshold_arg
+{
+        __s32 bd;
+        __s32 tag;
+        __s32 threshold;
+};
+
+/*
+ * Argument of BARRIER_IOC_AWAKE_N: wake up at most n of the processes sleeping on a tag of a
+ * barrier, in the order they went to sleep, leaving the others asleep
+ *
+ * bd: IPC identifier of the barrier
+ * tag: the tag
+ * n: maximum number of processes to be woken up
+ *
+ * Returns the number of processes woken up: in case n covers all the processes sleeping on
+ * the tag, the whole tag is woken up as by BARRIER_IOC_AWAKE
+ */
+
+struct barrier_awake_n_arg
+{
+        __s32 bd;
+        __s32 tag;
+        __s32 n;
+};
+
+/*
+ * Argument of BARRIER_IOC_SLEEP_TIMEOUT: sleep on a tag of a barrier for at most a given time
+ *
+ * bd: IPC identifier of the barrier
+ * tag: the tag
+ * flags: BARRIER_TIMEOUT_ABS in case the timeout is an absolute CLOCK_MONOTONIC time
+ * tv_sec, tv_nsec: the timeout
+ *
+ * Returns 0, or -1 with errno ETIMEDOUT in case the time elapses first
+ */
+
+struct barrier_timeout_arg
+{
+        __s32 bd;
+        __s32 tag;
+        __s32 flags;
+        __u32 pad;
+        __s64 tv_sec;
+        __s64 tv_nsec;
+};
+
+/*
+ * Operations of an entry of a batch (see "barrier_batch_arg")
+ *
+ * BARRIER_OP_GET: get the barrier with key "key" and flags "flags"; the result is its IPC identifier
+ * BARRIER_OP_AWAKE: wake up tag "tag" of barrier "bd"
+ * BARRIER_OP_RELEASE: release barrier "bd"
+ * BARRIER_OP_SLEEP: sleep on tag "tag" of barrier "bd"; this ends the batch, i.e. the following
+ * entries are not executed
+ */
+
+#define BARRIER_OP_GET 1
+#define BARRIER_OP_AWAKE 2
+#define BARRIER_OP_RELEASE 3
+#define BARRIER_OP_SLEEP 4
+
+/*
+ * Entry of a batch
+ *
+ * op: the operation, BARRIER_OP_*
+ * bd, tag: barrier and tag of the operation
+ * key, flags: key and flags of BARRIER_OP_GET
+ * result: written by the kernel, the value the single operation would return, i.e. the
+ * negative error code in case of error
+ */
+
+struct barrier_batch_entry
+{
+        __s32 op;
+        __s32 bd;
+        __s32 tag;
+        __s32 key;
+        __s32 flags;
+        __s32 result;
+};
+
+/*
+ * Argument of BARRIER_IOC_BATCH: execute several operations with a single ioctl, in order
+ *
+ * entries: user space address of the array of entries
+ * count: number of entries, at most BARRIER_BATCH_MAX
+ *
+ * Returns the number of entries executed: all of them, unless a BARRIER_OP_SLEEP ends the
+ * batch earlier. The outcome of each entry is in its "result" field. An entry that can't be
+ * read, or whose "result" can't be written, also ends the batch: the number of entries
+ * executed up to then (including the one whose "result" couldn't be written) is returned,
+ * and -EFAULT only in case no entry has been executed
+ */
+
+#define BARRIER_BATCH_MAX 1024
+
+struct barrier_batch_arg
+{
+        __u64 entries;
+        __u32 count;
+        __u32 pad;
+};
+
+/*
+ * The ioctl commands of the device: BARRIER_IOC_RELEASE takes the IPC identifier of the
+ * barrier to be released directly as argument
+ */
+
+#define BARRIER_IOC_GET _IOW(BARRIER_IOC_MAGIC,1,struct barrier_get_arg)
+#define BARRIER_IOC_RELEASE _IO(BARRIER_IOC_MAGIC,2)
+#define BARRIER_IOC_SLEEP _IOW(BARRIER_IOC_MAGIC,3,struct barrier_tag_arg)
+#define BARRIER_IOC_AWAKE _IOW(BARRIER_IOC_MAGIC,4,struct barrier_tag_arg)
+#define BARRIER_IOC_SLEEP_MASK _IOW(BARRIER_IOC_MAGIC,5,struct barrier_mask_arg)
+#define BARRIER_IOC_AWAKE_MASK _IOW(BARRIER_IOC_MAGIC,6,struct barrier_mask_arg)
+#define BARRIER_IOC_THRESHOLD _IOW(BARRIER_IOC_MAGIC,7,struct barrier_threshold_arg)
+#define BARRIER_IOC_SLEEP_TIMEOUT _IOW(BARRIER_IOC_MAGIC,8,struct barrier_timeout_arg)
+#define BARRIER_IOC_BATCH _IOW(BARRIER_IOC_MAGIC,9,struct barrier_batch_arg)
+#define BARRIER_IOC_WATCH _IOW(BARRIER_IOC_MAGIC,10,struct barrier_tag_arg)
+#define BARRIER_IOC_AWAKE_N _IOW(BARRIER_IOC_MAGIC,11,struct barrier_awake_n_arg)
+#define BARRIER_IOC_GET_LOCAL _IOW(BARRIER_IOC_MAGIC,12,struct barrier_get_arg)
+
+#endif //BARRIERSYNCHRONIZATION_BARRIER_IOCTL_H
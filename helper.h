@@ -1,17 +1,6 @@
 #ifndef BARRIERSYNCHRONIZATION_HELPER_C_H
 #define BARRIERSYNCHRONIZATION_HELPER_C_H
 
-#define WP_X86 0x00010000
-
-/*
- * Address of "sys_ ni_syscall": system call corresponding
- * to free entries of the system call table
- * THIS HAS TO BE TAKEN FROM THE SYSTEM MAP BECAUSE THE SYMBOL
- * IS NOT EXPORTED
- */
-
-unsigned long not_implemented_syscall=3222697504;
-
 /*
  * ADDRESSES OF FUNCTIONS FROM THE SYSTEM V IPC SUSBSYSTEM - start
  *
@@ -27,24 +16,6 @@ unsigned long not_implemented_syscall=3222697504;
 
 void (*ipc_init_ids)(struct ipc_ids* ids)=(void (*)(struct ipc_ids* ids))3224296752;
 
-/*
- * This function returns a new IPC synchronization object. The parameters given
- * determine the type and the features of the object that is going to be created
- * and they are:
- *
- * 1-key: this is an identifier that will be associated to the object
- * 2-flags: these determine some features of the object, for instance if it has
- * to created from scratch or if one with the same id has to be returned
- * 3-operations: callback functions associated to the operations of the object,first
- * of all its creation
- * 4-ipc_ids: reference to the structure used to manage all the instances of a certain
- * kind of synchronization object; there's one for all IPC semaphores,one for all IPC
- * shared memories and one for all IPC message queues.
- * 4-ipc_namespace:
- */
-
-int (*ipcget)(struct ipc_namespace *ns, struct ipc_ids *ids,struct ipc_ops *ops, struct ipc_params *params)=(int (*)(struct ipc_namespace *ns, struct ipc_ids *ids,struct ipc_ops *ops, struct ipc_params *params))3224296816;
-
 /*
  * This function is used to allocate memory for a new IPC synchronization object: since
  * RCU is used to guarantee parallelism of usage of these objects, when one is allocated
@@ -89,39 +60,22 @@ void (*ipc_rcu_putref)(void *ptr)=(void (*)(void *ptr))3224295984;
 struct kern_ipc_perm *(*ipc_lock_check)(struct ipc_ids *ids, int id)=(struct kern_ipc_perm *(*)(struct ipc_ids *ids, int id))3224297968;
 
 /*
- * ADDRESSES OF FUNCTIONS FROM THE SYSTEM V IPC SUSBSYSTEM - end
- */
-
-/*
- * Address of the system call table
- */
-
-unsigned long* system_call_table;
-
-/*
- * Indexes of the system calls table entries modified by the module
+ * Drop a reference to an IPC namespace, freeing it in case it was the last one: the function
+ * is declared by <linux/ipc_namespace.h> but not exported. Unlike the functions above, its
+ * address is looked up with "kallsyms_lookup_name" when the module is inserted, so it doesn't
+ * have to be taken from the System map; it stays NULL in case the kernel has no IPC namespaces
  */
 
-unsigned int restore[4];
+void (*barrier_put_ipc_ns)(struct ipc_namespace* ns);
 
 /*
- * Find address of the system call table
+ * The initial IPC namespace, which is never freed: its address is looked up in the same way
  */
 
-unsigned long* find_system_call_table(void);
+struct ipc_namespace* barrier_init_ipc_ns;
 
 /*
- * Find entries in the system call table corresponding to not implemented
- * system calls
- */
-
-void find_free_syscalls(unsigned long* table, unsigned int* restore);
-
-/*
- * Enable and disable write-protected mode
+ * ADDRESSES OF FUNCTIONS FROM THE SYSTEM V IPC SUSBSYSTEM - end
  */
 
-void enable_write_protected_mode(unsigned long* cr0);
-void disable_write_protected_mode(unsigned long* cr0);
-
 #endif //BARRIERSYNCHRONIZATION_HELPER_C_H